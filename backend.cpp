@@ -0,0 +1,246 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+
+/**
+ * \file backend.cpp
+ * \brief The boolean geometry engines the stipple may be made with.
+ */
+
+#include "geometry.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/geometries/multi_polygon.hpp>
+
+/// A point, polygon and set of polygons for boost::geometry.
+typedef bg::model::d2::point_xy<double> 						g_point;
+typedef bg::model::polygon<g_point> 							g_polygon;
+typedef bg::model::multi_polygon<g_polygon> 					g_polygon_set;
+
+static const PolygonBackend Polygon;
+static const GeometryBackend Geometry;
+
+/// Every backend, the default first.
+static const BooleanBackend *const Backends[] = { &Polygon, &Geometry };
+
+const BooleanBackend *
+FindBackend(const string &Name)
+{
+	if (Name.empty())  {
+		return Backends[0];
+	}
+
+	for (size_t b = 0; b < sizeof(Backends) / sizeof(Backends[0]); b++)  {
+		if (boost::algorithm::iequals(Name, Backends[b]->Name()))  {
+			return Backends[b];
+		}
+	}
+	return NULL;
+}
+
+const BooleanBackend &
+DefaultBackend()
+{
+	return *Backends[0];
+}
+
+vector<string>
+BackendNames()
+{
+	vector<string> Names;
+	for (size_t b = 0; b < sizeof(Backends) / sizeof(Backends[0]); b++)  {
+		Names.push_back(Backends[b]->Name());
+	}
+	return Names;
+}
+
+const char *
+PolygonBackend::Name() const
+{
+	return "polygon";
+}
+
+b_polygon_set
+PolygonBackend::Union(const b_polygon_set &Set) const
+{
+	gtl::polygon_set_data<int> Merged;
+	b_polygon_set Result;
+
+	Merged.insert(Set.begin(), Set.end());
+	Merged.get(Result);
+	return Result;
+}
+
+b_polygon_set
+PolygonBackend::Intersect(const b_polygon_set &A, const b_polygon_set &B) const
+{
+	b_polygon_set Result;
+
+	Result += A & B;
+	return Result;
+}
+
+b_polygon_set
+PolygonBackend::Resize(const b_polygon_set &Set, b_coord Distance) const
+{
+	b_polygon_set Result;
+
+	Result += Set;
+	if (Distance < 0)  {
+		Result -= (int)-Distance;
+	} else if (Distance > 0)  {
+		Result += (int)Distance;
+	}
+	return Result;
+}
+
+/// Append a boost::polygon ring to a boost::geometry one.
+template <class Iterator, class Ring>
+static void
+ToRing(Iterator First, Iterator Last, Ring &To)
+{
+	for ( ; First != Last; ++First)  {
+		bg::append(To, g_point(gtl::x(*First), gtl::y(*First)));
+	}
+}
+
+/// Convert polygons to boost::geometry, oriented and closed as it wants.
+static g_polygon_set
+ToGeometry(const b_polygon_set &Set)
+{
+	g_polygon_set Result;
+
+	Result.resize(Set.size());
+	for (size_t p = 0; p < Set.size(); p++)  {
+		ToRing(Set[p].begin(), Set[p].end(), Result[p].outer());
+		for (polygon_with_holes_traits<b_polygon>::iterator_holes_type
+				iHole = Set[p].begin_holes();
+				iHole != Set[p].end_holes(); ++iHole)  {
+			Result[p].inners().resize(Result[p].inners().size() + 1);
+			ToRing(iHole->begin(), iHole->end(), Result[p].inners().back());
+		}
+	}
+	bg::correct(Result);
+	return Result;
+}
+
+/// A boost::geometry ring, rounded to the nanometer.
+template <class Ring>
+static vector<b_point>
+FromRing(const Ring &From)
+{
+	vector<b_point> Points;
+
+	foreach(const g_point &Point, From)  {
+		Points.push_back(gtl::construct<b_point>(
+				(int)floor(Point.x() + 0.5), (int)floor(Point.y() + 0.5)));
+	}
+	return Points;
+}
+
+/// Convert polygons back from boost::geometry.
+static b_polygon_set
+FromGeometry(const g_polygon_set &Set)
+{
+	b_polygon_set Result(Set.size());
+
+	for (size_t p = 0; p < Set.size(); p++)  {
+		vector<b_point> Outer = FromRing(Set[p].outer());
+		vector< gtl::polygon_data<int> > Holes(Set[p].inners().size());
+
+		for (size_t h = 0; h < Holes.size(); h++)  {
+			vector<b_point> Hole = FromRing(Set[p].inners()[h]);
+			Holes[h].set(Hole.begin(), Hole.end());
+		}
+		Result[p].set(Outer.begin(), Outer.end());
+		Result[p].set_holes(Holes.begin(), Holes.end());
+	}
+	return Result;
+}
+
+/// Merge polygons which may overlap, pairwise and level by level, since
+/// boost::geometry only unions sets which are each already disjoint.
+static g_polygon_set
+Merge(const g_polygon_set &Set)
+{
+	vector<g_polygon_set> Level;
+
+	Level.resize(Set.size());
+	for (size_t p = 0; p < Set.size(); p++)  {
+		Level[p].push_back(Set[p]);
+	}
+
+	while (Level.size() > 1)  {
+		vector<g_polygon_set> Next((Level.size() + 1) / 2);
+		for (size_t m = 0; m + 1 < Level.size(); m += 2)  {
+			bg::union_(Level[m], Level[m + 1], Next[m / 2]);
+		}
+		if (Level.size() % 2)  {
+			Next.back() = Level.back();
+		}
+		Level.swap(Next);
+	}
+	return Level.empty() ? g_polygon_set() : Level[0];
+}
+
+const char *
+GeometryBackend::Name() const
+{
+	return "geometry";
+}
+
+b_polygon_set
+GeometryBackend::Union(const b_polygon_set &Set) const
+{
+	return FromGeometry(Merge(ToGeometry(Set)));
+}
+
+b_polygon_set
+GeometryBackend::Intersect(const b_polygon_set &A, const b_polygon_set &B) const
+{
+	g_polygon_set Left = Merge(ToGeometry(A));
+	g_polygon_set Right = Merge(ToGeometry(B));
+	g_polygon_set Result;
+
+	bg::intersection(Left, Right, Result);
+	return FromGeometry(Result);
+}
+
+b_polygon_set
+GeometryBackend::Resize(const b_polygon_set &Set, b_coord Distance) const
+{
+	g_polygon_set Merged = Merge(ToGeometry(Set));
+	g_polygon_set Result;
+
+	if (!Distance)  {
+		return FromGeometry(Merged);
+	}
+
+	bg::buffer(Merged, Result,
+			bg::strategy::buffer::distance_symmetric<double>(Distance),
+			bg::strategy::buffer::side_straight(),
+			bg::strategy::buffer::join_miter(),
+			bg::strategy::buffer::end_flat(),
+			bg::strategy::buffer::point_square());
+	return FromGeometry(Result);
+}
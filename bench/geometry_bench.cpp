@@ -0,0 +1,291 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file geometry_bench.cpp
+ * \brief Microbenchmarks of the geometry core, run outside of PCB.
+ *
+ * Each benchmark repeats its operation until a quarter second has passed,
+ * and reports the mean time per operation.  A name given on the command
+ * line runs only the benchmarks whose names contain it.
+ */
+
+#include "geometry.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// 7 mil traces on a 45 mil pitch, the dialog's defaults, in nanometers.
+static const b_coord Trace = 700 * 254;
+static const b_coord Pitch = 4500 * 254;
+
+/// A four inch square board, with an inch notched out of one corner.
+static const b_coord Side = 4 * 254000;
+
+/// Keeps the compiler from discarding a result.
+static volatile size_t Sink;
+
+static double
+Now()
+{
+	struct timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+/// One benchmark: a name, and a function which does the operation once and
+/// returns a size so the work can't be optimized away.
+struct Benchmark
+{
+	const char *Name;
+	size_t (*Operation)();
+};
+
+static b_polygon
+Outline()
+{
+	b_point Points[] = {
+		gtl::construct<b_point>(0, 0),
+		gtl::construct<b_point>(Side, 0),
+		gtl::construct<b_point>(Side, Side - Side/4),
+		gtl::construct<b_point>(Side - Side/4, Side - Side/4),
+		gtl::construct<b_point>(Side - Side/4, Side),
+		gtl::construct<b_point>(0, Side) };
+	b_polygon Polygon;
+
+	gtl::set_points(Polygon, Points, Points + 6);
+	return Polygon;
+}
+
+/// A grid of vias and a scatter of pads and traces across the board.
+static b_polygon_set
+Keepouts()
+{
+	b_polygon_set Set;
+	UnitCircle Unit;
+
+	srand(1);
+	for (b_coord y = Side/20; y < Side; y += Side/10)  {
+		for (b_coord x = Side/20; x < Side; x += Side/10)  {
+			Set.push_back(Unit.Overlay(x, y, Trace + 20 * 254 * 100 / 2));
+		}
+	}
+	for (int k = 0; k < 200; k++)  {
+		b_coord x = rand() % Side, y = rand() % Side;
+		if (k % 2)  {
+			Set.push_back(MakeRoundedRectangle(
+					x, y, x + 6000 * 254, y + 2500 * 254, Trace + 1000 * 254, 8));
+		} else  {
+			b_coord Thickness = Trace + 1000 * 254;
+			Set.push_back(MakeRectangularOverlay(
+					x, y, x + 40000 * 254, y + 30000 * 254, Thickness));
+			Set.push_back(MakeCircularOverlay(x, y, Thickness));
+			Set.push_back(MakeCircularOverlay(
+					x + 40000 * 254, y + 30000 * 254, Thickness));
+		}
+	}
+	return Set;
+}
+
+static const b_polygon TheOutline = Outline();
+static const b_polygon_set TheKeepouts = Keepouts();
+static const UnitCircle TheUnitCircle;
+
+static size_t
+CircularOverlay()
+{
+	return MakeCircularOverlay(Side/2, Side/2, Pitch).size();
+}
+
+static size_t
+UnitCircleOverlay()
+{
+	return TheUnitCircle.Overlay(Side/2, Side/2, Pitch).size();
+}
+
+static size_t
+RectangularOverlay()
+{
+	return MakeRectangularOverlay(0, 0, Side/3, Side/7, Trace).size();
+}
+
+static size_t
+RoundedRectangle()
+{
+	return MakeRoundedRectangle(0, 0, Side/30, Side/70, Trace, 8).size();
+}
+
+/// The vias, lines and pads of a small board, one call at a time.
+static size_t
+OverlaysEach()
+{
+	b_polygon_set Set;
+
+	for (int k = 0; k < 100; k++)  {
+		b_coord x = k * Side / 100;
+		Set.push_back(DefaultArcs().Circle(x, Side/3, Trace + 1400 * 254));
+		AddLineOverlay(Set, x, 0, x + Side/20, Side/7, Trace + 500 * 254);
+		Set.push_back(MakePadOverlay(x, Side/2, x, Side/2 + 6000 * 254,
+				Trace + 1250 * 254, Trace + 1000 * 254));
+	}
+	return Set.size();
+}
+
+/// The same board, made in one batch.
+static size_t
+OverlaysBatched()
+{
+	OverlayBatch Batch;
+	b_polygon_set Set;
+
+	for (int k = 0; k < 100; k++)  {
+		b_coord x = k * Side / 100;
+		Batch.AddCircle(x, Side/3, Trace + 1400 * 254);
+		Batch.AddLine(x, 0, x + Side/20, Side/7, Trace + 500 * 254);
+		Batch.AddPad(x, Side/2, x, Side/2 + 6000 * 254,
+				Trace + 1250 * 254, Trace + 1000 * 254);
+	}
+	Batch.Generate(Set, DefaultArcs());
+	return Set.size();
+}
+
+static size_t
+LatticePlan()
+{
+	StippleLattice Lattice;
+	gtl::rectangle_data<b_coord> Extents;
+
+	boost::polygon::extents(Extents, TheOutline);
+	Lattice.Plan(Extents, Trace, Pitch);
+	return Lattice.Rows * Lattice.Columns;
+}
+
+static size_t
+TilePlan()
+{
+	StippleTileSet Set;
+	vector<size_t> Candidates;
+
+	for (size_t k = 0; k < TheKeepouts.size(); k++)  {
+		Candidates.push_back(k);
+	}
+	Set.Plan(TheOutline, TheKeepouts, Candidates, Trace, Pitch);
+	return Set.Tiles.size();
+}
+
+/// The tiles of the board, planned once for the tile benchmarks.
+static const StippleTileSet &
+PlannedTiles()
+{
+	static StippleTileSet Set;
+
+	if (Set.Tiles.empty())  {
+		Set.Plan(TheOutline, TheKeepouts, vector<size_t>(), Trace, Pitch);
+	}
+	return Set;
+}
+
+/// The tile in the middle of the board, which has no edge to clip.
+static size_t
+InteriorTile()
+{
+	StippleTile Tile = PlannedTiles().Tiles[PlannedTiles().Tiles.size() / 2];
+	Tile.Calculate();
+	return Tile.CutOuts.Size();
+}
+
+/// The first tile, whose diamonds are clipped by two edges.
+static size_t
+EdgeTile()
+{
+	StippleTile Tile = PlannedTiles().Tiles[0];
+	Tile.Calculate();
+	return Tile.CutOuts.Size();
+}
+
+/// The middle tile again, in another pattern, planned once for each.
+template <StipplePattern::Shape Cell, int Angle>
+static size_t
+PatternTile()
+{
+	static StippleTileSet Set;
+
+	if (Set.Tiles.empty())  {
+		Set.Plan(TheOutline, TheKeepouts, vector<size_t>(), Trace, Pitch,
+				DefaultBackend(), StipplePattern(Cell, Angle));
+	}
+	StippleTile Tile = Set.Tiles[Set.Tiles.size() / 2];
+	Tile.Calculate();
+	return Tile.CutOuts.Size();
+}
+
+static size_t
+FullUnion()
+{
+	return StippleUnion(TheOutline, TheKeepouts, Trace, Pitch).CutOuts.Size();
+}
+
+static const Benchmark Benchmarks[] = {
+	{ "MakeCircularOverlay", CircularOverlay },
+	{ "UnitCircle::Overlay", UnitCircleOverlay },
+	{ "MakeRectangularOverlay", RectangularOverlay },
+	{ "MakeRoundedRectangle", RoundedRectangle },
+	{ "Overlays/each", OverlaysEach },
+	{ "OverlayBatch::Generate", OverlaysBatched },
+	{ "StippleLattice::Plan", LatticePlan },
+	{ "StippleTileSet::Plan", TilePlan },
+	{ "StippleTile::Calculate/interior", InteriorTile },
+	{ "StippleTile::Calculate/edge", EdgeTile },
+	{ "StippleTile::Calculate/square",
+			PatternTile<StipplePattern::Square, 0> },
+	{ "StippleTile::Calculate/hex", PatternTile<StipplePattern::Hex, 0> },
+	{ "StippleTile::Calculate/turned",
+			PatternTile<StipplePattern::Diamond, 30> },
+	{ "StippleUnion", FullUnion },
+};
+
+int
+main(int argc, char **argv)
+{
+	printf("%-36s %12s %14s\n", "Benchmark", "Iterations", "Time/op (us)");
+
+	for (size_t b = 0; b < sizeof(Benchmarks) / sizeof(Benchmarks[0]); b++)  {
+
+		const Benchmark &Bench = Benchmarks[b];
+		if (argc > 1 && !strstr(Bench.Name, argv[1]))  {
+			continue;
+		}
+
+		long Iterations = 0;
+		double Start = Now(), Elapsed;
+		do  {
+			Sink = Bench.Operation();
+			++Iterations;
+		} while ((Elapsed = Now() - Start) < 0.25);
+
+		printf("%-36s %12ld %14.3f\n",
+				Bench.Name, Iterations, 1e6 * Elapsed / Iterations);
+	}
+	return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file scaling_bench.cpp
+ * \brief Scaling curves of the stipple pipeline over synthetic boards.
+ *
+ * A synthetic board is a comb shaped template polygon, whose teeth set its
+ * concavity, overlapped by a second rectangle, with vias, lines and
+ * pad-bearing elements scattered over it.  Each phase of the layer
+ * pipeline is timed through the same calls the plugin makes, minus PCB
+ * itself:
+ *
+ * - read: the template points into Boost polygons, by ReadTemplatePolygon
+ * - union: the merge of the templates into islands, as MakeLayer
+ * - load: the keepouts of every object, by OverlayBatch's keepout adders,
+ *   merged into regions
+ * - stipple: the lattice, clipping and overlays, as CalculateStipples
+ * - insert: flattening into point and hole lists, by FlattenStippled and
+ *   FlattenOverlay
+ *
+ * One parameter at a time is swept from the defaults, and every board is
+ * run through each boolean backend, one line of CSV on stdout per run.  A
+ * sweep name on the command line runs only that sweep, and a backend name
+ * after it only that backend.
+ */
+
+#include "geometry.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// Dialog units, hundredths of a mil, to nanometers.
+static const b_coord Unit = 254;
+
+/// The parameters of one synthetic board and its stipple.
+struct Board
+{
+	/// The side of the square template area, in mils.
+	int Side;
+
+	/// The number of notches cut into the template's top edge.
+	int Teeth;
+
+	/// The stipple trace and pitch, in mils.
+	int Trace, Pitch;
+
+	/// The number of vias, lines and elements, each with four pads and
+	/// two pins.
+	int Vias, Lines, Elements;
+
+	/// The chord tolerance of the keepouts' arcs, in hundredths of a mil,
+	/// or zero for the fixed steps.
+	int Tolerance;
+};
+
+/// A point as PCB holds it.
+struct FlatPoint
+{
+	b_coord X, Y;
+};
+
+/// A PCB polygon: its points, and where each hole starts.
+struct FlatPolygon
+{
+	vector<FlatPoint> Points;
+	vector<size_t> HoleIndex;
+};
+
+static double
+Now()
+{
+	struct timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static FlatPolygon
+Rectangle(b_coord x0, b_coord y0, b_coord x1, b_coord y1)
+{
+	FlatPolygon Polygon;
+	FlatPoint Points[] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+
+	Polygon.Points.assign(Points, Points + 4);
+	return Polygon;
+}
+
+/// The template layer: a comb whose notches reach a third of the way down,
+/// and a rectangle overlapping its lower right corner.
+static vector<FlatPolygon>
+Templates(const Board &B)
+{
+	b_coord Side = B.Side * 100 * Unit;
+	FlatPolygon Comb;
+
+	FlatPoint Origin = { 0, 0 };
+	Comb.Points.push_back(Origin);
+	for (int t = 0; t < B.Teeth; t++)  {
+		b_coord Left = Side * (2 * t + 1) / (2 * B.Teeth + 1);
+		b_coord Right = Side * (2 * t + 2) / (2 * B.Teeth + 1);
+		FlatPoint Notch[] = {
+			{ Left, 0 }, { Left, Side / 3 }, { Right, Side / 3 }, { Right, 0 } };
+		Comb.Points.insert(Comb.Points.end(), Notch, Notch + 4);
+	}
+	FlatPoint Rest[] = { { Side, 0 }, { Side, Side }, { 0, Side } };
+	Comb.Points.insert(Comb.Points.end(), Rest, Rest + 3);
+
+	vector<FlatPolygon> Layer;
+	Layer.push_back(Comb);
+	Layer.push_back(Rectangle(Side / 2, Side / 2, Side + Side / 4, Side + Side / 4));
+	return Layer;
+}
+
+/// As ReadTemplatePolygons, less PCB's polygon list.
+static b_polygon_set
+Read(const vector<FlatPolygon> &Layer)
+{
+	b_polygon_set PolygonSet;
+
+	foreach(const FlatPolygon &Flat, Layer)  {
+		PolygonSet.push_back(
+				ReadTemplatePolygon(&Flat.Points[0], Flat.Points.size()));
+	}
+	return PolygonSet;
+}
+
+/// As LoadPCB, with the objects scattered at random over the template area
+/// and a quarter beyond it.  Sizes are those of a typical 0805 and 10 mil
+/// trace design.
+static b_polygon_set
+Load(const Board &B)
+{
+	b_coord Side = B.Side * 100 * Unit, Reach = Side + Side / 4;
+	b_coord Trace = B.Trace * 100 * Unit;
+	b_polygon_set Keepouts;
+	ArcTessellation Arcs(B.Tolerance * Unit);
+	OverlayBatch Batch;
+
+	// A via's y, and a line's rise, are drawn before their x, as the
+	// boards have always been drawn.
+	srand(1);
+	for (int v = 0; v < B.Vias; v++)  {
+		b_coord y = rand() % Reach;
+		b_coord x = rand() % Reach;
+		Batch.AddHoleKeepout(x, y, 2800 * Unit, 2000 * Unit, Trace);
+	}
+	for (int l = 0; l < B.Lines; l++)  {
+		b_coord x = rand() % Reach, y = rand() % Reach;
+		b_coord dy = rand() % (Side / 8) - Side / 16;
+		b_coord dx = rand() % (Side / 8);
+		Batch.AddLineKeepout(x, y, x + dx, y + dy,
+				1000 * Unit, 2000 * Unit, Trace);
+	}
+	for (int e = 0; e < B.Elements; e++)  {
+		b_coord x = rand() % Reach, y = rand() % Reach;
+		for (int p = 0; p < 4; p++)  {
+			Batch.AddPadKeepout(
+					x + p * 5000 * Unit, y, x + p * 5000 * Unit, y + 6000 * Unit,
+					2500 * Unit, 2000 * Unit, Trace);
+		}
+		for (int p = 0; p < 2; p++)  {
+			Batch.AddHoleKeepout(x + p * 10000 * Unit, y - 10000 * Unit,
+					6000 * Unit, 2000 * Unit, Trace);
+		}
+	}
+	Batch.Generate(Keepouts, Arcs);
+	return Keepouts;
+}
+
+/// As BuildPolygons on an unsplit union, with vectors for PCB's polygons.
+static size_t
+Insert(const vector<StippledPolygon> &Stippled)
+{
+	size_t Points = 0;
+
+	foreach(const StippledPolygon &Union, Stippled)  {
+
+		vector<size_t> CutOuts(Union.CutOuts.Size());
+		for (size_t r = 0; r < CutOuts.size(); r++)  {
+			CutOuts[r] = r;
+		}
+
+		FlatPolygon Outline;
+		Outline.Points.resize(
+				FlatPointCount(Union.Outline, Union.CutOuts, CutOuts));
+		Outline.HoleIndex.resize(CutOuts.size());
+		FlattenStippled(Union.Outline, Union.CutOuts, CutOuts,
+				&Outline.Points[0],
+				CutOuts.empty() ? NULL : &Outline.HoleIndex[0]);
+		Points += Outline.Points.size();
+
+		foreach(const b_polygon &Overlay, Union.Overlays)  {
+			FlatPolygon Flat;
+			Flat.Points.resize(Overlay.size());
+			FlattenOverlay(Overlay, &Flat.Points[0]);
+			Points += Flat.Points.size();
+		}
+	}
+	return Points;
+}
+
+static void
+Run(const char *Sweep, const Board &B, const BooleanBackend &Backend)
+{
+	double Start, Read_s, Union_s, Load_s, Stipple_s, Insert_s;
+	vector<FlatPolygon> Layer = Templates(B);
+	size_t CutOuts = 0, Overlays = 0, Points;
+
+	Start = Now();
+	b_polygon_set PolygonSet = Read(Layer);
+	Read_s = Now() - Start;
+
+	Start = Now();
+	UnionReduction Templates;
+	Templates.Plan(PolygonSet, Backend);
+	Templates.Calculate();
+	b_polygon_set Union = Templates.Result();
+	Union_s = Now() - Start;
+
+	Start = Now();
+	b_polygon_set Loaded = Load(B);
+	UnionReduction Consolidation;
+	Consolidation.Plan(Loaded, Backend);
+	Consolidation.Calculate();
+	b_polygon_set Keepouts = Consolidation.Result();
+	Load_s = Now() - Start;
+
+	Start = Now();
+	vector<StippledPolygon> Stippled;
+	foreach(const b_polygon &Polygon, Union)  {
+		Stippled.push_back(StippleUnion(Polygon, Keepouts,
+				B.Trace * 100 * Unit, B.Pitch * 100 * Unit, Backend));
+		CutOuts += Stippled.back().CutOuts.Size();
+		Overlays += Stippled.back().Overlays.size();
+	}
+	Stipple_s = Now() - Start;
+
+	Start = Now();
+	Points = Insert(Stippled);
+	Insert_s = Now() - Start;
+
+	printf("%s,%s,%d,%d,%d,%d,%d,%d,%d,%d,%lu,"
+			"%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%lu,%lu,%lu\n",
+			Sweep, Backend.Name(), B.Side, B.Teeth, B.Trace, B.Pitch, B.Vias, B.Lines,
+			B.Elements, B.Tolerance, (unsigned long)Loaded.size(),
+			1e3 * Read_s, 1e3 * Union_s, 1e3 * Load_s, 1e3 * Stipple_s,
+			1e3 * Insert_s,
+			1e3 * (Read_s + Union_s + Load_s + Stipple_s + Insert_s),
+			(unsigned long)CutOuts, (unsigned long)Overlays,
+			(unsigned long)Points);
+	fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+	// A two inch pour, 7 mil traces on a 45 mil pitch, a few dozen parts,
+	// and arcs to a tenth of a mil, as the dialog defaults to.
+	const Board Default = { 2000, 4, 7, 45, 50, 50, 10, 10 };
+
+	int Sides[] = { 500, 1000, 2000, 4000, 8000 };
+	int Teeth[] = { 0, 4, 16, 64, 256 };
+	int Pitches[] = { 100, 70, 45, 30, 20 };
+	int Vias[] = { 0, 50, 100, 200, 400 };
+	int Lines[] = { 0, 25, 50, 100, 200 };
+	int Elements[] = { 0, 5, 10, 20, 40 };
+	int Tolerances[] = { 0, 2, 10, 50, 100 };
+	const char *Only = argc > 1 ? argv[1] : NULL;
+	vector<const BooleanBackend *> Backends;
+
+	foreach(const string &Name, BackendNames())  {
+		if (argc < 3 || !strcmp(argv[2], Name.c_str()))  {
+			Backends.push_back(FindBackend(Name));
+		}
+	}
+
+	printf("sweep,backend,side_mil,teeth,trace_mil,pitch_mil,vias,lines,elements,"
+			"tolerance,keepouts,read_ms,union_ms,load_ms,stipple_ms,insert_ms,total_ms,"
+			"cutouts,overlays,points\n");
+
+	for (int k = 0; k < 5; k++)  {
+		Board B = Default;
+
+		if (!Only || !strcmp(Only, "side"))  {
+			B = Default; B.Side = Sides[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("side", B, *Backend);
+			}
+		}
+		if (!Only || !strcmp(Only, "teeth"))  {
+			B = Default; B.Teeth = Teeth[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("teeth", B, *Backend);
+			}
+		}
+		if (!Only || !strcmp(Only, "pitch"))  {
+			B = Default; B.Pitch = Pitches[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("pitch", B, *Backend);
+			}
+		}
+		if (!Only || !strcmp(Only, "vias"))  {
+			B = Default; B.Vias = Vias[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("vias", B, *Backend);
+			}
+		}
+		if (!Only || !strcmp(Only, "lines"))  {
+			B = Default; B.Lines = Lines[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("lines", B, *Backend);
+			}
+		}
+		if (!Only || !strcmp(Only, "elements"))  {
+			B = Default; B.Elements = Elements[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("elements", B, *Backend);
+			}
+		}
+		if (!Only || !strcmp(Only, "tolerance"))  {
+			B = Default; B.Tolerance = Tolerances[k];
+			foreach(const BooleanBackend *Backend, Backends)  {
+				Run("tolerance", B, *Backend);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file cache.cpp
+ * \brief The on-disk cache of stippled unions.
+ *
+ * Each file is a run of native 32 bit words: a magic number and version,
+ * the outline, the number of cutouts and each cutout, then the number of
+ * overlays and each overlay.  A polygon is its ring count (the outer ring
+ * and then any holes), and for each ring its point count and points.
+ */
+
+#include "stipple.hpp"
+#include <glib/gstdio.h>
+
+StippleCache *ResultCache;
+
+/// "STPL", then the format version.
+static const gint32 CacheMagic = 0x4c505453;
+static const gint32 CacheVersion = 1;
+
+static string
+CacheFile(const string &Directory, const string &Hash)
+{
+	return Directory + "/" + Hash + ".bin";
+}
+
+template <class Iterator>
+static void
+WriteRing(vector<gint32> &Words, Iterator First, Iterator Last)
+{
+	Words.push_back(Last - First);
+	for ( ; First != Last; ++First)  {
+		Words.push_back(gtl::x(*First));
+		Words.push_back(gtl::y(*First));
+	}
+}
+
+static void
+WritePolygon(vector<gint32> &Words, const b_polygon &Polygon)
+{
+	Words.push_back(1 + Polygon.size_holes());
+	WriteRing(Words, Polygon.begin(), Polygon.end());
+	for (polygon_with_holes_traits<b_polygon>::iterator_holes_type
+			iHole = Polygon.begin_holes();
+			iHole != Polygon.end_holes(); ++iHole)  {
+		WriteRing(Words, iHole->begin(), iHole->end());
+	}
+}
+
+/// Read back one ring, failing if it would run past Last.
+static bool
+ReadRing(const gint32 *&Next, const gint32 *Last,
+		gtl::polygon_data<int> &Ring)
+{
+	if (Next >= Last || *Next < 0 || Last - (Next + 1) < 2 * (long)*Next)  {
+		return false;
+	}
+
+	vector<b_point> Points(*Next++);
+	for (size_t p = 0; p < Points.size(); p++, Next += 2)  {
+		Points[p] = gtl::construct<b_point>(Next[0], Next[1]);
+	}
+	Ring.set(Points.begin(), Points.end());
+	return true;
+}
+
+static bool
+ReadPolygon(const gint32 *&Next, const gint32 *Last, b_polygon &Polygon)
+{
+	if (Next >= Last || *Next < 1)  {
+		return false;
+	}
+
+	int Rings = *Next++;
+	gtl::polygon_data<int> Outer;
+	vector< gtl::polygon_data<int> > Holes(Rings - 1);
+
+	if (!ReadRing(Next, Last, Outer))  {
+		return false;
+	}
+	for (int h = 0; h < Rings - 1; h++)  {
+		if (!ReadRing(Next, Last, Holes[h]))  {
+			return false;
+		}
+	}
+	Polygon.set(Outer.begin(), Outer.end());
+	Polygon.set_holes(Holes.begin(), Holes.end());
+	return true;
+}
+
+static bool
+ReadPolygonSet(const gint32 *&Next, const gint32 *Last, b_polygon_set &Set)
+{
+	if (Next >= Last || *Next < 0)  {
+		return false;
+	}
+
+	Set.resize(*Next++);
+	for (size_t p = 0; p < Set.size(); p++)  {
+		if (!ReadPolygon(Next, Last, Set[p]))  {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Read back a set of polygons as rings, keeping only their outer rings,
+/// which are all a RingSet holds.
+static bool
+ReadRingSet(const gint32 *&Next, const gint32 *Last, RingSet &Set)
+{
+	if (Next >= Last || *Next < 0)  {
+		return false;
+	}
+
+	gtl::polygon_data<int> Ring;
+	for (int p = *Next++; p > 0; p--)  {
+		if (Next >= Last || *Next < 1)  {
+			return false;
+		}
+		int Rings = *Next++;
+		for (int r = 0; r < Rings; r++)  {
+			if (!ReadRing(Next, Last, Ring))  {
+				return false;
+			}
+			if (r == 0)  {
+				Set.Add(Ring.begin(), Ring.end());
+			}
+		}
+	}
+	return true;
+}
+
+StippleCache::StippleCache()
+	: Directory(string(g_get_home_dir()) + stipple_cache),
+	  Hits(0), Misses(0)
+{
+	g_mutex_init (&Mutex);
+	g_mkdir_with_parents(Directory.c_str(), 0755);
+}
+
+StippleCache::~StippleCache()
+{
+	g_mutex_clear (&Mutex);
+}
+
+bool
+StippleCache::Fetch(const string &Key, StippledPolygon &Stippled)
+{
+	string File = CacheFile(Directory, Key);
+	GMappedFile *Mapped = g_mapped_file_new(File.c_str(), FALSE, NULL);
+	bool Found = false;
+
+	if (Mapped)  {
+
+		const gint32 *Next =
+				(const gint32 *)g_mapped_file_get_contents(Mapped);
+		const gint32 *Last =
+				Next + g_mapped_file_get_length(Mapped) / sizeof(gint32);
+
+		StippledPolygon Cached;
+		Cached.Hash = Stippled.Hash;
+
+		Found = Last - Next >= 2 &&
+				CacheMagic == *Next++ && CacheVersion == *Next++ &&
+				ReadPolygon(Next, Last, Cached.Outline) &&
+				ReadRingSet(Next, Last, Cached.CutOuts) &&
+				ReadPolygonSet(Next, Last, Cached.Overlays) &&
+				Next == Last;
+		g_mapped_file_unref(Mapped);
+
+		if (Found)  {
+			Stippled.Outline = Cached.Outline;
+			Stippled.CutOuts.Swap(Cached.CutOuts);
+			Stippled.Overlays.swap(Cached.Overlays);
+
+			// Touch the file, so it is the last to be trimmed.
+			g_utime(File.c_str(), NULL);
+		} else  {
+			g_unlink(File.c_str());
+		}
+	}
+
+	g_mutex_lock (&Mutex);
+	Found ? ++Hits : ++Misses;
+	g_mutex_unlock (&Mutex);
+	return Found;
+}
+
+void
+StippleCache::Store(const string &Key, const StippledPolygon &Stippled)
+{
+	vector<gint32> Words;
+
+	Words.push_back(CacheMagic);
+	Words.push_back(CacheVersion);
+	WritePolygon(Words, Stippled.Outline);
+
+	// Cutouts are written as polygons of one ring each.
+	Words.push_back(Stippled.CutOuts.Size());
+	for (size_t r = 0; r < Stippled.CutOuts.Size(); r++)  {
+		Words.push_back(1);
+		WriteRing(Words, Stippled.CutOuts.Begin(r), Stippled.CutOuts.End(r));
+	}
+
+	Words.push_back(Stippled.Overlays.size());
+	foreach(const b_polygon &Overlay, Stippled.Overlays)  {
+		WritePolygon(Words, Overlay);
+	}
+
+	// Written aside and renamed, so a reader never maps half a file.
+	g_file_set_contents(CacheFile(Directory, Key).c_str(),
+			(const gchar *)&Words[0], Words.size() * sizeof(gint32), NULL);
+}
+
+void
+StippleCache::Trim()
+{
+	GDir *Dir = g_dir_open(Directory.c_str(), 0, NULL);
+	if (!Dir)  {
+		return;
+	}
+
+	long Total = 0;
+	vector< pair<time_t, pair<string, long> > > Files;
+	const gchar *Name;
+
+	while (NULL != (Name = g_dir_read_name(Dir)))  {
+
+		string Path = Directory + "/" + Name;
+		GStatBuf Status;
+
+		if (!g_str_has_suffix(Name, ".bin") ||
+				g_stat(Path.c_str(), &Status))  {
+			continue;
+		}
+		Files.push_back(make_pair(Status.st_mtime,
+				make_pair(Path, (long)Status.st_size)));
+		Total += Status.st_size;
+	}
+	g_dir_close(Dir);
+
+	// Oldest first.
+	sort(Files.begin(), Files.end());
+	for (size_t f = 0; f < Files.size() && Total > StippleCacheLimit; f++)  {
+		g_unlink(Files[f].second.first.c_str());
+		Total -= Files[f].second.second;
+	}
+}
@@ -27,38 +27,134 @@
 
 #include "stipple.hpp"
 
-bool Cancel;
+CancelToken Cancel;
+ProgressChannel StippleProgress;
 
 static GtkWidget *dialog, *ProgressLabel,
 *TopLayer, *BottomLayer, *BothLayers, *SelectedPolygons, *DeletePolygons,
 *TopTraceEdit, *TopPitchEdit,
-*BottomTraceEdit, *BottomPitchEdit, *PercentFillMessage;
+*BottomTraceEdit, *BottomPitchEdit, *ToleranceEdit, *HolesEdit,
+*PercentFillMessage;
 
 static GtkProgressBar *ProgressBar;
 
-static float percent_progress = 0.0;
-static string ProgressMessage = "Stipple Progress";
+/// The fraction last shown, so the bar never goes backwards.
+static double percent_progress = 0.0;
+
+/// Whether a run started from the dialog is still going.  Its layer
+/// threads read the board throughout, so the dialog stays modal, and the
+/// board safe from edits, until the run ends, even once canceled.
+static bool Running = false;
+
+ProgressChannel::ProgressChannel()
+	: Current(-1), Done(0)
+{
+}
+
+void
+ProgressChannel::Begin(const vector<string> &LayerNames)
+{
+	Names = LayerNames;
+	Layers.assign(Names.size(), LayerCounts());
+	for (size_t l = 0; l < Layers.size(); l++)  {
+		Layers[l].Unions = Layers[l].UnionsDone = 0;
+		Layers[l].Tiles = Layers[l].TilesDone = 0;
+	}
+	g_atomic_int_set(&Current, -1);
+	g_atomic_int_set(&Done, 0);
+}
+
+void
+ProgressChannel::Unions(int Layer, int Count)
+{
+	g_atomic_int_set(&Layers[Layer].Unions, Count);
+}
+
+void
+ProgressChannel::StartUnion(int Layer, int Tiles)
+{
+	g_atomic_int_set(&Layers[Layer].TilesDone, 0);
+	g_atomic_int_set(&Layers[Layer].Tiles, Tiles);
+	g_atomic_int_set(&Current, Layer);
+}
+
+void
+ProgressChannel::TileDone(int Layer)
+{
+	g_atomic_int_inc(&Layers[Layer].TilesDone);
+}
+
+void
+ProgressChannel::UnionDone(int Layer)
+{
+	// The tiles are cleared first, so the union is never counted twice.
+	g_atomic_int_set(&Layers[Layer].Tiles, 0);
+	g_atomic_int_inc(&Layers[Layer].UnionsDone);
+}
 
 void
-StippleDialog::Progress(float progress, string Message)
+ProgressChannel::Finish()
+{
+	g_atomic_int_set(&Done, 1);
+}
+
+double
+ProgressChannel::Fraction() const
+{
+	double Sum = 0;
+
+	// Each layer is an equal share, and each union an equal share of it.
+	for (size_t l = 0; l < Layers.size(); l++)  {
+		int Unions = g_atomic_int_get(&Layers[l].Unions);
+		int UnionsDone = g_atomic_int_get(&Layers[l].UnionsDone);
+		int Tiles = g_atomic_int_get(&Layers[l].Tiles);
+		int TilesDone = g_atomic_int_get(&Layers[l].TilesDone);
+
+		if (Unions > 0)  {
+			double Union = Tiles > 0 ? min(1.0, (double)TilesDone / Tiles) : 0;
+			Sum += min(1.0, (UnionsDone + Union) / Unions);
+		}
+	}
+	return 0.05 + 0.95 * (Layers.empty() ? 0 : Sum / Layers.size());
+}
+
+string
+ProgressChannel::Message() const
+{
+	int Layer = g_atomic_int_get(&Current);
+
+	if (Finished())  {
+		return "Polygon Stipple Ends";
+	} else if (Layer < 0)  {
+		return "Polygon Stipple Begins...";
+	}
+	return str(boost::format("Area %d of %d for \"%s\"...") %
+			min(g_atomic_int_get(&Layers[Layer].UnionsDone) + 1,
+				g_atomic_int_get(&Layers[Layer].Unions)) %
+			g_atomic_int_get(&Layers[Layer].Unions) % Names[Layer]);
+}
+
+bool
+ProgressChannel::Finished() const
 {
-	percent_progress = progress;
-	ProgressMessage = Message;
+	return g_atomic_int_get(&Done);
 }
 
 gboolean
 StippleDialog::UpdateProgress(GtkProgressBar *PB)
 {
-	if (Cancel || 2.0 == percent_progress)  {
+	if (StippleProgress.Finished())  {
+		Running = false;
 		if (dialog != NULL) gtk_widget_destroy (dialog);
 		dialog = NULL;
 		return FALSE;
 	}
 
-	gtk_label_set_text ((GtkLabel *)ProgressLabel, ProgressMessage.c_str());
+	gtk_label_set_text ((GtkLabel *)ProgressLabel,
+			StippleProgress.Message().c_str());
 
+	percent_progress = max(percent_progress, StippleProgress.Fraction());
 	if (percent_progress > 1.0) percent_progress = 1.0;
-	if (percent_progress < 0.0) percent_progress = 0.0;
 	gtk_progress_bar_set_fraction (PB, percent_progress);
 
 	return TRUE;
@@ -124,21 +220,7 @@ StippleDialog::ButtonPress( GtkButton *widget, gpointer data )
 			Log("No Layer Specification\n");
 		}
 
-		MakeLayerNames.clear();
-		switch (MakeLayers)  {
-		case MakeTopLayer:
-			MakeLayerNames.push_back(component_perimeter);
-			break;
-		case MakeBottomLayer:
-			MakeLayerNames.push_back(solder_perimeter);
-			break;
-		case MakeDelete:
-		case MakeSelected:
-		case MakeBothLayers:
-			MakeLayerNames.push_back(component_perimeter);
-			MakeLayerNames.push_back(solder_perimeter);
-			break;
-		}
+		WorkOrder();
 
 		try  {
 		Buffer = gtk_editable_get_chars (GTK_EDITABLE (TopTraceEdit), 0, -1);
@@ -149,10 +231,14 @@ StippleDialog::ButtonPress( GtkButton *widget, gpointer data )
 		SolderTrace = boost::lexical_cast<int>(Buffer);
 		Buffer = gtk_editable_get_chars (GTK_EDITABLE (BottomPitchEdit), 0, -1);
 		SolderPitch = boost::lexical_cast<int>(Buffer);
+		Buffer = gtk_editable_get_chars (GTK_EDITABLE (ToleranceEdit), 0, -1);
+		ArcTolerance = boost::lexical_cast<int>(Buffer);
+		Buffer = gtk_editable_get_chars (GTK_EDITABLE (HolesEdit), 0, -1);
+		SplitHoles = boost::lexical_cast<int>(Buffer);
 		}
 		catch(boost::bad_lexical_cast &) {
 			cout << "Bad Trace/Pitch parameter input" << endl;
-			Cancel = true;
+			Cancel.Raise();
 			return;
 		}
 
@@ -164,6 +250,8 @@ StippleDialog::ButtonPress( GtkButton *widget, gpointer data )
 		  WritePrefs << "ComponentPitch = " << ComponentPitch << endl;
 		  WritePrefs << "SolderTrace = " << SolderTrace << endl;
 		  WritePrefs << "SolderPitch = " << SolderPitch << endl;
+		  WritePrefs << "ArcTolerance = " << ArcTolerance << endl;
+		  WritePrefs << "SplitHoles = " << SplitHoles << endl;
 		  WritePrefs << "DefaultAction = 1\n";
 		  WritePrefs.close();
 
@@ -175,16 +263,153 @@ StippleDialog::ButtonPress( GtkButton *widget, gpointer data )
 		SolderTrace		= SolderTrace 		* MilToNanometer;
 		ComponentPitch	= ComponentPitch 	* MilToNanometer;
 		SolderPitch		= SolderPitch 		* MilToNanometer;
-
-		Cancel = false;
+		ArcTolerance	= ArcTolerance		* MilToNanometer;
+
+		Cancel.Reset();
+		TileThreads = 0;
+		InsertOnMainLoop = true;
+		ReportFile.clear();
+		GerberFile.clear();
+		TraceFile = g_getenv("STIPPLE_TRACE") ? g_getenv("STIPPLE_TRACE") : "";
+		BackendName =
+				g_getenv("STIPPLE_BACKEND") ? g_getenv("STIPPLE_BACKEND") : "";
+		Pattern = StipplePattern();
+		StippleProgress.Begin(MakeLayerNames);
+		percent_progress = 0.0;
 		g_timeout_add(500, (GSourceFunc)UpdateProgress, (gpointer)ProgressBar);
+		Running = true;
 		g_thread_new("Stipple Thread", (GThreadFunc)MakeAllLayers, NULL);
 
 	} else {
-		Cancel = true;
+		Cancel.Raise();
+	}
+}
+
+void
+StippleDialog::UndoPress( GtkButton *widget, gpointer data )
+{
+	// The journal is the board's only record of a run, and a run still
+	// going has yet to file its step.
+	if (Running)  {
+		return;
+	}
+
+	bool Undo = !strcmp(GTK_STOCK_UNDO, gtk_button_get_label (widget));
+	if (!(Undo ? Journal.Undo() : Journal.Redo()))  {
+		Log("No stipple run to %s\n", Undo ? "undo" : "redo");
 	}
 }
 
+void
+StippleDialog::WorkOrder()
+{
+	MakeLayerNames.clear();
+	switch (MakeLayers)  {
+	case MakeTopLayer:
+		MakeLayerNames.push_back(component_perimeter);
+		break;
+	case MakeBottomLayer:
+		MakeLayerNames.push_back(solder_perimeter);
+		break;
+	case MakeDelete:
+	case MakeSelected:
+	case MakeBothLayers:
+		MakeLayerNames.push_back(component_perimeter);
+		MakeLayerNames.push_back(solder_perimeter);
+		break;
+	}
+}
+
+int
+StippleDialog::Batch(int argc, char **argv)
+{
+	// In the order of MakeLayers_t, and of the dialog's entries.
+	const char *Modes[] = { "Top", "Bottom", "Both", "Selected", "Delete" };
+	Coord *Parameters[] =
+		{ &ComponentTrace, &ComponentPitch, &SolderTrace, &SolderPitch };
+	unsigned Parameter = 0;
+
+	// Undoing and redoing stand alone, and start no run.
+	if (argc == 1 && (!g_ascii_strcasecmp(argv[0], "Undo") ||
+			!g_ascii_strcasecmp(argv[0], "Redo")))  {
+		bool Undo = !g_ascii_strcasecmp(argv[0], "Undo");
+		if (!(Undo ? Journal.Undo() : Journal.Redo()))  {
+			Log("No stipple run to %s\n", Undo ? "undo" : "redo");
+		}
+		return 0;
+	}
+
+	ReadDefaults();
+	MakeLayers = MakeBothLayers;
+	TileThreads = 0;
+	InsertOnMainLoop = false;
+	ReportFile.clear();
+	GerberFile.clear();
+	TraceFile.clear();
+	BackendName.clear();
+	Pattern = StipplePattern();
+
+	for (int a = 0; a < argc; a++)  {
+
+		string Argument = argv[a];
+		unsigned Mode = 0;
+
+		while (Mode < G_N_ELEMENTS(Modes) &&
+				g_ascii_strcasecmp(Modes[Mode], argv[a]))  {
+			Mode++;
+		}
+
+		try  {
+			if (Mode < G_N_ELEMENTS(Modes))  {
+				MakeLayers = (MakeLayers_t)Mode;
+			} else if (!Argument.compare(0, 8, "Threads="))  {
+				TileThreads = boost::lexical_cast<int>(Argument.substr(8));
+			} else if (!Argument.compare(0, 7, "Report="))  {
+				ReportFile = Argument.substr(7);
+			} else if (!Argument.compare(0, 7, "Gerber="))  {
+				GerberFile = Argument.substr(7);
+			} else if (!Argument.compare(0, 6, "Trace="))  {
+				TraceFile = Argument.substr(6);
+			} else if (!Argument.compare(0, 8, "Backend="))  {
+				BackendName = Argument.substr(8);
+			} else if (!Argument.compare(0, 8, "Pattern="))  {
+				if (!Pattern.Choose(Argument.substr(8)))  {
+					throw boost::bad_lexical_cast();
+				}
+			} else if (!Argument.compare(0, 6, "Angle="))  {
+				Pattern.Angle =
+						boost::lexical_cast<double>(Argument.substr(6));
+			} else if (!Argument.compare(0, 6, "Holes="))  {
+				SplitHoles = boost::lexical_cast<int>(Argument.substr(6));
+			} else if (!Argument.compare(0, 10, "Tolerance="))  {
+				ArcTolerance =
+						boost::lexical_cast<int>(Argument.substr(10));
+			} else if (Parameter < G_N_ELEMENTS(Parameters))  {
+				*Parameters[Parameter++] = boost::lexical_cast<int>(Argument);
+			} else  {
+				throw boost::bad_lexical_cast();
+			}
+		}
+		catch(boost::bad_lexical_cast &) {
+			Log("Bad stipple argument \"%.64s\"\n", argv[a]);
+			return 1;
+		}
+	}
+
+	WorkOrder();
+
+	ComponentTrace	= ComponentTrace 	* MilToNanometer;
+	SolderTrace		= SolderTrace 		* MilToNanometer;
+	ComponentPitch	= ComponentPitch 	* MilToNanometer;
+	SolderPitch		= SolderPitch 		* MilToNanometer;
+	ArcTolerance	= ArcTolerance		* MilToNanometer;
+
+	Cancel.Reset();
+	StippleProgress.Begin(MakeLayerNames);
+	MakeAllLayers();
+	return 0;
+}
+
 int
 StippleDialog::PercentFill(double Trace, double Pitch)
 {
@@ -242,6 +467,8 @@ StippleDialog::ReadDefaults()
 		ComponentPitch = ReadDefault(File, "ComponentPitch", 4500);
 		SolderTrace = ReadDefault(File, "SolderTrace", 700);
 		SolderPitch = ReadDefault(File, "SolderPitch", 7000);
+		ArcTolerance = ReadDefault(File, "ArcTolerance", 10);
+		SplitHoles = ReadDefault(File, "SplitHoles", 0);
 
 	}  else  {
 
@@ -255,6 +482,8 @@ StippleDialog::ReadDefaults()
 		  WritePrefs << "ComponentPitch = 4500\n";
 		  WritePrefs << "SolderTrace = 700\n";
 		  WritePrefs << "SolderPitch = 7000\n";
+		  WritePrefs << "ArcTolerance = 10\n";
+		  WritePrefs << "SplitHoles = 0\n";
 		  WritePrefs << "DefaultAction = 1\n";
 		  WritePrefs.close();
 
@@ -265,6 +494,8 @@ StippleDialog::ReadDefaults()
 		ComponentPitch	= 4500;
 		SolderTrace		= 700;
 		SolderPitch		= 7000;
+		ArcTolerance	= 10;
+		SplitHoles		= 0;
 	}
 
 	return 0;
@@ -283,7 +514,7 @@ StippleDialog::ParameterDialog()
 	GtkWidget *separator, *button;
 	GSList *group;
 
-	Cancel = false;
+	Cancel.Reset();
 
 	ReadDefaults();
 
@@ -339,6 +570,8 @@ StippleDialog::ParameterDialog()
 	BottomTraceEdit	= gtk_entry_new ();
 	TopPitchEdit 	= gtk_entry_new ();
 	BottomPitchEdit	= gtk_entry_new ();
+	ToleranceEdit	= gtk_entry_new ();
+	HolesEdit		= gtk_entry_new ();
 
 	hbox = gtk_hbox_new (FALSE, 4);
 	gtk_container_set_border_width (GTK_CONTAINER (hbox), 4);
@@ -389,6 +622,32 @@ StippleDialog::ParameterDialog()
 	content_area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
 	gtk_container_add (GTK_CONTAINER (content_area), hbox);
 
+	hbox = gtk_hbox_new (FALSE, 4);
+	gtk_container_set_border_width (GTK_CONTAINER (hbox), 4);
+	label = gtk_label_new ("Arc Tolerance");
+	gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+	Buffer = boost::lexical_cast<string>(ArcTolerance);
+	gtk_editable_insert_text(GTK_EDITABLE (ToleranceEdit),
+		(gchar *) Buffer.c_str(), Buffer.length(), &position);
+	gtk_entry_set_activates_default (GTK_ENTRY (ToleranceEdit), TRUE);
+	gtk_box_pack_start (GTK_BOX (hbox), ToleranceEdit, FALSE, FALSE, 0);
+
+	content_area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
+	gtk_container_add (GTK_CONTAINER (content_area), hbox);
+
+	hbox = gtk_hbox_new (FALSE, 4);
+	gtk_container_set_border_width (GTK_CONTAINER (hbox), 4);
+	label = gtk_label_new ("Holes per Polygon");
+	gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+	Buffer = boost::lexical_cast<string>(SplitHoles);
+	gtk_editable_insert_text(GTK_EDITABLE (HolesEdit),
+		(gchar *) Buffer.c_str(), Buffer.length(), &position);
+	gtk_entry_set_activates_default (GTK_ENTRY (HolesEdit), TRUE);
+	gtk_box_pack_start (GTK_BOX (hbox), HolesEdit, FALSE, FALSE, 0);
+
+	content_area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
+	gtk_container_add (GTK_CONTAINER (content_area), hbox);
+
 	vbox = gtk_vbox_new (FALSE, 4);
 	gtk_container_set_border_width (GTK_CONTAINER (vbox), 4);
 	separator = gtk_hseparator_new ();
@@ -397,10 +656,9 @@ StippleDialog::ParameterDialog()
 	content_area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
 	gtk_container_add (GTK_CONTAINER (content_area), vbox);
 
-	ProgressMessage = "Stipple Progress";
 	hbox = gtk_hbox_new (FALSE, 4);
 	gtk_container_set_border_width (GTK_CONTAINER (hbox), 4);
-	ProgressLabel = gtk_label_new (ProgressMessage.c_str());
+	ProgressLabel = gtk_label_new ("Stipple Progress");
 	gtk_box_pack_start (GTK_BOX (hbox), ProgressLabel, TRUE, TRUE, 0);
 	content_area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
 	gtk_container_add (GTK_CONTAINER (content_area), hbox);
@@ -425,6 +683,14 @@ StippleDialog::ParameterDialog()
 	gtk_button_box_set_layout (GTK_BUTTON_BOX (vbox), GTK_BUTTONBOX_END);
 	gtk_container_set_border_width (GTK_CONTAINER (vbox), 5);
 	gtk_box_set_spacing (GTK_BOX (vbox), 20);
+	button = gtk_button_new_from_stock (GTK_STOCK_UNDO);
+	gtk_signal_connect (GTK_OBJECT (button), "clicked",
+			GTK_SIGNAL_FUNC (UndoPress), NULL);
+	gtk_box_pack_start (GTK_BOX (vbox), (GtkWidget *)button, FALSE, FALSE, 0);
+	button = gtk_button_new_from_stock (GTK_STOCK_REDO);
+	gtk_signal_connect (GTK_OBJECT (button), "clicked",
+			GTK_SIGNAL_FUNC (UndoPress), NULL);
+	gtk_box_pack_start (GTK_BOX (vbox), (GtkWidget *)button, FALSE, FALSE, 0);
 	button = gtk_button_new_from_stock (GTK_STOCK_OK);
 	gtk_signal_connect (GTK_OBJECT (button), "clicked",
 			GTK_SIGNAL_FUNC (ButtonPress), NULL);
@@ -444,4 +710,13 @@ StippleDialog::ParameterDialog()
 
 	gtk_widget_show_all (dialog);
 	gtk_dialog_run (GTK_DIALOG (dialog));
+
+	// Closing the window ends gtk_dialog_run, and its modality, but not
+	// the run.
+	if (Running)  {
+		gtk_window_set_modal (GTK_WINDOW (dialog), TRUE);
+		while (Running)  {
+			gtk_main_iteration ();
+		}
+	}
 }
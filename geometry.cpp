@@ -0,0 +1,1427 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file geometry.cpp
+ * \brief The overlays, the diamond lattice and its tiles.
+ */
+
+#include "geometry.hpp"
+#include <time.h>
+#include <boost/format.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+const char *const PhaseNames[PhaseCount] = {
+	"read", "union", "load", "lattice", "container",
+	"overlay", "stitch", "insert"
+};
+
+/// Seconds on the given clock.
+static double
+Seconds(clockid_t Clock)
+{
+	struct timespec Time;
+	clock_gettime(Clock, &Time);
+	return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+PhaseTimes::PhaseTimes()
+{
+	fill(Wall, Wall + PhaseCount, 0.0);
+	fill(Cpu, Cpu + PhaseCount, 0.0);
+}
+
+void
+PhaseTimes::Add(const PhaseTimes &Other)
+{
+	for (int p = 0; p < PhaseCount; p++)  {
+		Wall[p] += Other.Wall[p];
+		Cpu[p] += Other.Cpu[p];
+	}
+}
+
+PhaseClock::PhaseClock()
+	: Wall(Seconds(CLOCK_MONOTONIC)), Cpu(Seconds(CLOCK_THREAD_CPUTIME_ID))
+{
+}
+
+void
+PhaseClock::Charge(PhaseTimes &Times, StipplePhase Phase)
+{
+	double WallNow = Seconds(CLOCK_MONOTONIC);
+	double CpuNow = Seconds(CLOCK_THREAD_CPUTIME_ID);
+
+	Times.Wall[Phase] += WallNow - Wall;
+	Times.Cpu[Phase] += CpuNow - Cpu;
+	Wall = WallNow;
+	Cpu = CpuNow;
+}
+
+void
+StippleHash::Add(long long Datum)
+{
+	for (int Byte = 0; Byte < 8; Byte++)  {
+		Value ^= (Datum >> (8 * Byte)) & 0xff;
+		Value *= 1099511628211ULL;
+	}
+}
+
+string
+StippleHash::Hex() const
+{
+	return str(boost::format("%016x") % Value);
+}
+
+double
+Angle2D(int X0, int Y0, int X1, int Y1)
+{
+	return atan2((double)(X1 - X0),  (double)(Y1 - Y0));
+}
+
+b_polygon
+MakeCircularOverlay(
+		b_coord x, b_coord y, b_coord Radius, int SegmentCount)
+{
+	if (24 == SegmentCount)  {
+		return DefaultArcs().Circle(x, y, Radius);
+	}
+	return UnitCircle(SegmentCount).Overlay(x, y, Radius);
+}
+
+/// The normal to a line, Thickness long, as sin and cos of Angle2D would
+/// have it but with no trigonometry.  A line of no length takes the
+/// normal along x, as atan2 gives it.
+static inline void
+LineNormal(double Dx, double Dy, b_coord Thickness, int &Nx, int &Ny)
+{
+	double Length = sqrt(Dx * Dx + Dy * Dy);
+
+	Nx = Length > 0 ? Thickness * (Dy / Length) : Thickness;
+	Ny = Length > 0 ? -Thickness * (Dx / Length) : 0;
+}
+
+/// The rectangle over a line, bloated on either side by its normal.
+static b_polygon
+LineRectangle(b_coord x0, b_coord y0, b_coord x1, b_coord y1, int Nx, int Ny)
+{
+	b_point EdgeSet[] = {
+		gtl::construct<b_point>(x0 + Nx, y0 + Ny),
+		gtl::construct<b_point>(x0 - Nx, y0 - Ny),
+		gtl::construct<b_point>(x1 - Nx, y1 - Ny),
+		gtl::construct<b_point>(x1 + Nx, y1 + Ny),
+		gtl::construct<b_point>(x0 + Nx, y0 + Ny) };
+	b_polygon Overlay;
+
+	Overlay.set(EdgeSet, EdgeSet + 5);
+	return Overlay;
+}
+
+/// The box a pad's keepout rounds: the pad grown by Clear on every side,
+/// with its sides put in order as a Boost rectangle would.
+static inline void
+PadBox(b_coord &x0, b_coord &y0, b_coord &x1, b_coord &y1, b_coord Clear)
+{
+	b_coord Left = x0 - Clear, Right = x1 + Clear;
+	b_coord Top = y0 - Clear, Bottom = y1 + Clear;
+
+	x0 = min(Left, Right);
+	x1 = max(Left, Right);
+	y0 = min(Top, Bottom);
+	y1 = max(Top, Bottom);
+}
+
+void
+AddLineOverlay(b_polygon_set &Set,
+		b_coord x0, b_coord y0, b_coord x1, b_coord y1, b_coord Thickness,
+		const ArcTessellation &Arcs)
+{
+	Set.push_back(MakeRectangularOverlay(x0, y0, x1, y1, Thickness));
+	Set.push_back(Arcs.Circle(x0, y0, Thickness));
+	Set.push_back(Arcs.Circle(x1, y1, Thickness));
+}
+
+b_polygon
+MakePadOverlay(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+		b_coord Clear, int Radius, const ArcTessellation &Arcs)
+{
+	PadBox(x0, y0, x1, y1, Clear);
+	return Arcs.RoundedRectangle(x0, y0, x1, y1, Radius);
+}
+
+void
+OverlayBatch::AddCircle(b_coord x, b_coord y, b_coord Radius)
+{
+	CircleX.push_back(x);
+	CircleY.push_back(y);
+	CircleRadius.push_back(Radius);
+}
+
+void
+OverlayBatch::AddLine(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+		b_coord Thickness)
+{
+	LineX0.push_back(x0);
+	LineY0.push_back(y0);
+	LineX1.push_back(x1);
+	LineY1.push_back(y1);
+	LineThickness.push_back(Thickness);
+}
+
+void
+OverlayBatch::AddPad(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+		b_coord Clear, b_coord Radius)
+{
+	PadX0.push_back(x0);
+	PadY0.push_back(y0);
+	PadX1.push_back(x1);
+	PadY1.push_back(y1);
+	PadClear.push_back(Clear);
+	PadRadius.push_back(Radius);
+}
+
+void
+OverlayBatch::AddHoleKeepout(b_coord x, b_coord y, b_coord Thickness,
+		b_coord Clearance, b_coord Trace)
+{
+	AddCircle(x, y, Trace + (Thickness + Clearance)/(b_coord)2);
+}
+
+void
+OverlayBatch::AddLineKeepout(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+		b_coord Thickness, b_coord Clearance, b_coord Trace)
+{
+	AddLine(x0, y0, x1, y1, Trace + (Thickness + Clearance)/(b_coord)2);
+}
+
+void
+OverlayBatch::AddPadKeepout(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+		b_coord Thickness, b_coord Clearance, b_coord Trace)
+{
+	AddPad(x0, y0, x1, y1, Trace + Thickness/2 + Clearance/2,
+			Trace + Clearance/2);
+}
+
+size_t
+OverlayBatch::Size() const
+{
+	return CircleX.size() + 3 * LineX0.size() + PadX0.size();
+}
+
+void
+OverlayBatch::Clear()
+{
+	CircleX.clear();
+	CircleY.clear();
+	CircleRadius.clear();
+	LineX0.clear();
+	LineY0.clear();
+	LineX1.clear();
+	LineY1.clear();
+	LineThickness.clear();
+	PadX0.clear();
+	PadY0.clear();
+	PadX1.clear();
+	PadY1.clear();
+	PadClear.clear();
+	PadRadius.clear();
+}
+
+void
+OverlayBatch::Generate(b_polygon_set &Set, const ArcTessellation &Arcs) const
+{
+	size_t Circles = CircleX.size(), Lines = LineX0.size(), Pads = PadX0.size();
+	const UnitCircle *Unit = NULL;
+	b_coord UnitRadius = -1;
+
+	Set.reserve(Set.size() + Size());
+
+	// Vias and pins mostly share a handful of sizes, so the steps are
+	// looked up again only when the radius changes.
+	for (size_t c = 0; c < Circles; c++)  {
+		if (CircleRadius[c] != UnitRadius)  {
+			UnitRadius = CircleRadius[c];
+			Unit = &Arcs.Steps(UnitRadius);
+		}
+		Set.push_back(Unit->Overlay(CircleX[c], CircleY[c], UnitRadius));
+	}
+
+	// Every line's normal, straight down the columns, then the rectangles
+	// and the barbells.
+	vector<int> NormalX(Lines), NormalY(Lines);
+	for (size_t l = 0; l < Lines; l++)  {
+		LineNormal(LineX1[l] - LineX0[l], LineY1[l] - LineY0[l],
+				LineThickness[l], NormalX[l], NormalY[l]);
+	}
+	for (size_t l = 0; l < Lines; l++)  {
+		if (LineThickness[l] != UnitRadius)  {
+			UnitRadius = LineThickness[l];
+			Unit = &Arcs.Steps(UnitRadius);
+		}
+		Set.push_back(LineRectangle(LineX0[l], LineY0[l], LineX1[l], LineY1[l],
+				NormalX[l], NormalY[l]));
+		Set.push_back(Unit->Overlay(LineX0[l], LineY0[l], UnitRadius));
+		Set.push_back(Unit->Overlay(LineX1[l], LineY1[l], UnitRadius));
+	}
+
+	// Likewise every pad's box, then its corners.
+	vector<b_coord> Left(PadX0), Top(PadY0), Right(PadX1), Bottom(PadY1);
+	for (size_t p = 0; p < Pads; p++)  {
+		PadBox(Left[p], Top[p], Right[p], Bottom[p], PadClear[p]);
+	}
+	for (size_t p = 0; p < Pads; p++)  {
+		if (Arcs.Tolerance <= 0)  {
+			Set.push_back(Arcs.RoundedRectangle(
+					Left[p], Top[p], Right[p], Bottom[p], PadRadius[p]));
+			continue;
+		}
+		if (PadRadius[p] != UnitRadius)  {
+			UnitRadius = PadRadius[p];
+			Unit = &Arcs.Steps(UnitRadius);
+		}
+		Set.push_back(Unit->RoundedRectangle(
+				Left[p], Top[p], Right[p], Bottom[p], UnitRadius));
+	}
+}
+
+void
+RingSet::Append(const RingSet &Other)
+{
+	size_t Base = Vertices.size();
+
+	Vertices.insert(Vertices.end(), Other.Vertices.begin(), Other.Vertices.end());
+	for (size_t r = 1; r < Other.Offsets.size(); r++)  {
+		Offsets.push_back(Base + Other.Offsets[r]);
+	}
+}
+
+void
+RingSet::Reserve(size_t Rings, size_t Points)
+{
+	Offsets.reserve(Offsets.size() + Rings);
+	Vertices.reserve(Vertices.size() + Points);
+}
+
+void
+RingSet::Clear()
+{
+	Vertices.clear();
+	Offsets.assign(1, 0);
+}
+
+void
+RingSet::Swap(RingSet &Other)
+{
+	Vertices.swap(Other.Vertices);
+	Offsets.swap(Other.Offsets);
+}
+
+UnitCircle::UnitCircle(int SegmentCount, bool Circumscribed)
+	: Circumscribed(Circumscribed)
+{
+	double dTheta = PI/SegmentCount/2;
+
+	if (!Circumscribed)  {
+		for (double iTheta = -PI; iTheta <= PI; iTheta += dTheta)  {
+			Cos.push_back(cos(iTheta));
+			Sin.push_back(sin(iTheta));
+		}
+		return;
+	}
+
+	// Half a step off the axes, each quarter turn starts and ends on a
+	// chord which touches the circle on an axis, so the straight sides of
+	// a rounded rectangle run on from its corners without a step.
+	double Scale = 1.0 / cos(dTheta/2);
+	for (int k = 0; k < 4 * SegmentCount; k++)  {
+		double Theta = -PI + (k + 0.5) * dTheta;
+		Cos.push_back(Scale * cos(Theta));
+		Sin.push_back(Scale * sin(Theta));
+	}
+}
+
+b_polygon
+UnitCircle::Overlay(b_coord x, b_coord y, b_coord Radius) const
+{
+	vector<b_point> EdgeSet(Cos.size());
+	b_polygon Overlay;
+
+	for (size_t k = 0; k < Cos.size(); k++)  {
+		EdgeSet[k] = gtl::construct<b_point>(
+				x + Radius * Cos[k],
+				y + Radius * Sin[k]);
+	}
+	if (Circumscribed)  {
+		EdgeSet.push_back(EdgeSet.front());
+	}
+	Overlay.set(EdgeSet.begin(), EdgeSet.end());
+	return Overlay;
+}
+
+/// The most steps to a quarter turn a tolerance may ask for, and the
+/// fewest.
+static const int MaxSegments = 64, MinSegments = 2;
+
+ArcTessellation::ArcTessellation(b_coord Tolerance)
+	: Tolerance(Tolerance)
+{
+	if (Tolerance <= 0)  {
+		Circles.push_back(UnitCircle());
+		return;
+	}
+
+	Circles.reserve(MaxSegments + 1);
+	for (int Segments = 0; Segments <= MaxSegments; Segments++)  {
+		Circles.push_back(UnitCircle(max(Segments, MinSegments), true));
+	}
+}
+
+int
+ArcTessellation::Segments(b_coord Radius) const
+{
+	if (Tolerance <= 0)  {
+		return 24;
+	}
+	if (Radius <= 0)  {
+		return MinSegments;
+	}
+
+	// A chord pushed out to touch the circle strays furthest at its ends,
+	// Radius / cos(half a step) from the center.
+	double HalfStep = acos((double)Radius / (Radius + Tolerance));
+	int Segments = (int)ceil(PI / 4 / HalfStep);
+	return max(MinSegments, min(Segments, MaxSegments));
+}
+
+b_polygon
+ArcTessellation::Circle(b_coord x, b_coord y, b_coord Radius) const
+{
+	return Steps(Radius).Overlay(x, y, Radius);
+}
+
+const UnitCircle &
+ArcTessellation::Steps(b_coord Radius) const
+{
+	if (Tolerance <= 0)  {
+		return Circles[0];
+	}
+	return Circles[Segments(Radius)];
+}
+
+b_polygon
+ArcTessellation::RoundedRectangle(b_coord x0, b_coord y0,
+		b_coord x1, b_coord y1, b_coord Radius) const
+{
+	if (Tolerance <= 0)  {
+		return Corners.Overlay(x0, y0, x1, y1, Radius);
+	}
+	return Circles[Segments(Radius)].RoundedRectangle(x0, y0, x1, y1, Radius);
+}
+
+b_polygon
+UnitCircle::RoundedRectangle(b_coord x0, b_coord y0,
+		b_coord x1, b_coord y1, b_coord Radius) const
+{
+	int Count = Cos.size() / 4;
+	b_coord CenterX[] = { x0 + Radius, x1 - Radius, x1 - Radius, x0 + Radius };
+	b_coord CenterY[] = { y0 + Radius, y0 + Radius, y1 - Radius, y1 - Radius };
+	vector<b_point> EdgeSet;
+	b_polygon Overlay;
+
+	// The unit circle runs from the left, so each quarter of it in turn
+	// is the corner at one of the centers, and the sides join them up.
+	EdgeSet.reserve(4 * Count + 1);
+	for (int Corner = 0; Corner < 4; Corner++)  {
+		for (int k = Corner * Count; k < (Corner + 1) * Count; k++)  {
+			EdgeSet.push_back(gtl::construct<b_point>(
+					CenterX[Corner] + Radius * Cos[k],
+					CenterY[Corner] + Radius * Sin[k]));
+		}
+	}
+	EdgeSet.push_back(EdgeSet.front());
+
+	Overlay.set(EdgeSet.begin(), EdgeSet.end());
+	return Overlay;
+}
+
+UnitCorners::UnitCorners(int Smoothness)
+{
+	double dTheta = PI/Smoothness/8;
+
+	// The same steps, in the same order, MakeRoundedRectangle takes.
+	for (double iTheta = PI/2; iTheta <= PI; iTheta += dTheta)  {
+		Cos[0].push_back(-cos(iTheta));
+		Sin[0].push_back(-sin(iTheta));
+	}
+	for (double iTheta = 0; iTheta >= -PI/2; iTheta -= dTheta)  {
+		Cos[1].push_back(cos(iTheta));
+		Sin[1].push_back(-sin(iTheta));
+	}
+	for (double iTheta = -PI/2; iTheta <= 0; iTheta += dTheta)  {
+		Cos[2].push_back(-cos(iTheta));
+		Sin[2].push_back(-sin(iTheta));
+	}
+	for (double iTheta = 0; iTheta <= PI/2; iTheta += dTheta)  {
+		Cos[3].push_back(-cos(iTheta));
+		Sin[3].push_back(-sin(iTheta));
+	}
+}
+
+b_polygon
+UnitCorners::Overlay(b_coord x0, b_coord y0,
+		b_coord x1, b_coord y1, b_coord Radius) const
+{
+	b_coord CenterX[] = { x1 - Radius, x1 - Radius, x0 + Radius, x0 + Radius };
+	b_coord CenterY[] = { y0 + Radius, y1 - Radius, y1 - Radius, y0 + Radius };
+
+	// Each corner is led into by its side, as MakeRoundedRectangle draws.
+	b_point Sides[][2] = {
+		{ gtl::construct<b_point>(x0 + Radius, y0),
+		  gtl::construct<b_point>(x1 - Radius, y0) },
+		{ gtl::construct<b_point>(x1, y0 + Radius),
+		  gtl::construct<b_point>(x1, y1 - Radius) },
+		{ gtl::construct<b_point>(x1 - Radius, y1),
+		  gtl::construct<b_point>(x0 + Radius, y1) },
+		{ gtl::construct<b_point>(x0, y1 - Radius),
+		  gtl::construct<b_point>(x0, y0 + Radius) } };
+	vector<b_point> EdgeSet;
+	b_polygon Overlay;
+
+	EdgeSet.reserve(8 + 4 * Cos[0].size() + 4);
+	for (int Corner = 0; Corner < 4; Corner++)  {
+		EdgeSet.push_back(Sides[Corner][0]);
+		EdgeSet.push_back(Sides[Corner][1]);
+		for (size_t k = 0; k < Cos[Corner].size(); k++)  {
+			EdgeSet.push_back(gtl::construct<b_point>(
+					CenterX[Corner] + Radius * Cos[Corner][k],
+					CenterY[Corner] + Radius * Sin[Corner][k]));
+		}
+	}
+
+	Overlay.set(EdgeSet.begin(), EdgeSet.end());
+	return Overlay;
+}
+
+const ArcTessellation &
+DefaultArcs()
+{
+	static const ArcTessellation Fixed;
+	return Fixed;
+}
+
+b_polygon
+MakeRectangularOverlay(
+		b_coord x0, b_coord y0, b_coord x1, b_coord y1, b_coord Thickness)
+{
+	int Nx, Ny;
+
+	LineNormal(x1 - x0, y1 - y0, Thickness, Nx, Ny);
+	return LineRectangle(x0, y0, x1, y1, Nx, Ny);
+}
+
+b_polygon
+MakeRoundedRectangle(
+		int x0, int y0, int x1, int y1, int Radius, int Smoothness)
+{
+	if (8 == Smoothness)  {
+		return DefaultArcs().RoundedRectangle(x0, y0, x1, y1, Radius);
+	}
+	return UnitCorners(Smoothness).Overlay(x0, y0, x1, y1, Radius);
+}
+
+const char *
+StipplePattern::Name(Shape Cell)
+{
+	static const char *Names[ShapeCount] = { "diamond", "square", "hex" };
+	return Names[Cell];
+}
+
+bool
+StipplePattern::Choose(const string &Name)
+{
+	for (int s = 0; s < ShapeCount; s++)  {
+		if (boost::algorithm::iequals(Name, this->Name((Shape)s)))  {
+			Cell = (Shape)s;
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+StippleLattice::Plan(gtl::rectangle_data<b_coord> Area,
+		b_coord Trace, b_coord Pitch, const StipplePattern &Pattern)
+{
+	const double Pi = boost::math::constants::pi<double>();
+
+	this->Pattern = Pattern;
+	Cos = cos(Pattern.Angle * Pi / 180);
+	Sin = sin(Pattern.Angle * Pi / 180);
+
+	switch (Pattern.Cell)  {
+	case StipplePattern::Square:
+		// Square holes in square rows, a pitch apart each way.
+		Dx = Dy = Pitch;
+		Inset = 0;
+		HalfWidth = HalfHeight = (Pitch - Trace) / 2;
+		break;
+	case StipplePattern::Hex:
+		// Pointed-top hexagons, the rows nested into one another.
+		Dx = Pitch;
+		Dy = Pitch * sqrt(3) / 2;
+		Inset = Pitch / 2;
+		HalfWidth = (Pitch - Trace) / 2;
+		HalfHeight = (Pitch - Trace) / sqrt(3);
+		break;
+	default:
+		// Squares on their points, each row half a diagonal below the
+		// last and inset by half of one.
+		Dx = Spacing(Trace, Pitch);
+		Dy = Inset = Dx / 2;
+		HalfWidth = HalfHeight = (b_coord)((Pitch - Trace) * sqrt(2)) / 2;
+		break;
+	}
+
+	Extents = Area;
+	if (Turned())  {
+		b_point Corner = ToLattice(xl(Area), yl(Area));
+		Extents = gtl::rectangle_data<b_coord>(gtl::x(Corner), gtl::y(Corner),
+				gtl::x(Corner), gtl::y(Corner));
+		gtl::encompass(Extents, ToLattice(xh(Area), yl(Area)));
+		gtl::encompass(Extents, ToLattice(xl(Area), yh(Area)));
+		gtl::encompass(Extents, ToLattice(xh(Area), yh(Area)));
+	}
+
+	X0 = Dx * (xl(Extents) / Dx);
+	Y0 = Dx * (yl(Extents) / Dx);
+
+	// Rows run one pitch past the extents.
+	Rows = 0;
+	while (RowY(Rows) < yh(Extents) + Dx)  {
+		++Rows;
+	}
+
+	// The inset rows start half a pitch early, so they are the widest.
+	Columns = 0;
+	while (ColumnX(0, Columns) < xh(Extents) + Dx)  {
+		++Columns;
+	}
+}
+
+b_coord
+StippleLattice::Spacing(b_coord Trace, b_coord Pitch)
+{
+	// Cypress refers to a 7 mil line with a 7 mil spacing as a 10% fill
+	b_coord Dx_Line = Trace * sqrt(2);
+	b_coord Dx_Hole = (Pitch - Trace) * sqrt(2);
+	return Dx_Line + Dx_Hole;
+}
+
+b_point
+StippleLattice::ToLattice(double X, double Y) const
+{
+	return b_point(floor(X * Cos + Y * Sin + 0.5),
+			floor(Y * Cos - X * Sin + 0.5));
+}
+
+b_point
+StippleLattice::ToBoard(double X, double Y) const
+{
+	return b_point(floor(X * Cos - Y * Sin + 0.5),
+			floor(Y * Cos + X * Sin + 0.5));
+}
+
+b_coord
+StippleLattice::RowY(int Row) const
+{
+	return Y0 + Row * Dy;
+}
+
+b_coord
+StippleLattice::ColumnX(int Row, int Column) const
+{
+	// ping-pong to inset the squares to form a mosaic pattern
+	return X0 + Column * Dx - (Row % 2 ? 0 : Inset);
+}
+
+void
+StippleTile::ClassifyRow(const vector<b_segment> &Edges, b_coord Y,
+		vector<double> &Crossings, vector<b_span> &Boundary)
+{
+	// A turned frame's edges and cells were each rounded to the unit, so
+	// they are given that much more room.
+	double Slack = Set->Lattice.Turned() ? 2 : 0;
+	double Top = Y - Set->Lattice.HalfHeight - Slack;
+	double Bottom = Y + Set->Lattice.HalfHeight + Slack;
+
+	Crossings.clear();
+	Boundary.clear();
+
+	foreach(const b_segment &Edge, Edges)  {
+
+		double x0 = gtl::x(gtl::low(Edge)), y0 = gtl::y(gtl::low(Edge));
+		double x1 = gtl::x(gtl::high(Edge)), y1 = gtl::y(gtl::high(Edge));
+
+		if (max(y0, y1) < Top || min(y0, y1) > Bottom)  {
+			continue;
+		}
+
+		// Half-open, so a vertex on the center line is only counted once.
+		if ((y0 <= Y) != (y1 <= Y))  {
+			Crossings.push_back(x0 + (Y - y0) * (x1 - x0) / (y1 - y0));
+		}
+
+		// The part of the edge within the band, widened by a unit so that
+		// rounding can only ever send a diamond down the boolean path.
+		double Left = min(x0, x1), Right = max(x0, x1);
+		if (y0 != y1)  {
+			double xTop = x0 + (max(Top, min(y0, y1)) - y0) * (x1 - x0) / (y1 - y0);
+			double xBottom = x0 + (min(Bottom, max(y0, y1)) - y0) * (x1 - x0) / (y1 - y0);
+			Left = min(xTop, xBottom);
+			Right = max(xTop, xBottom);
+		}
+		Boundary.push_back(b_span(Left - 1 - Slack, Right + 1 + Slack));
+	}
+
+	sort(Crossings.begin(), Crossings.end());
+	sort(Boundary.begin(), Boundary.end());
+
+	// Merge overlapping spans so that both ends are in order.
+	size_t Merged = 0;
+	for (size_t k = 0; k < Boundary.size(); k++)  {
+		if (Merged && Boundary[k].first <= Boundary[Merged - 1].second)  {
+			Boundary[Merged - 1].second =
+					max(Boundary[Merged - 1].second, Boundary[k].second);
+		} else {
+			Boundary[Merged++] = Boundary[k];
+		}
+	}
+	Boundary.resize(Merged);
+}
+
+/// The cells of the patterns.  Each writes the cutout centered at X, Y of
+/// the lattice's frame, its first point repeated at the end, returning the
+/// number of points.  Points is the most any cutout takes.
+
+class DiamondCell
+{
+	public:
+
+		enum { Points = 5 };
+
+		static size_t
+		Emit(const StippleLattice &Lattice, b_coord X, b_coord Y, b_coord *At)
+		{
+			b_coord Half = Lattice.HalfWidth;
+			b_coord Ring[] = {
+				X+Half, Y,		// Right
+				X, Y+Half,		// Bottom
+				X-Half, Y,		// Left
+				X, Y-Half,		// Top
+				X+Half, Y };	// Right
+
+			copy(Ring, Ring + 2 * Points, At);
+			return Points;
+		}
+};
+
+class SquareCell
+{
+	public:
+
+		enum { Points = 5 };
+
+		static size_t
+		Emit(const StippleLattice &Lattice, b_coord X, b_coord Y, b_coord *At)
+		{
+			b_coord Half = Lattice.HalfWidth;
+			b_coord Ring[] = {
+				X+Half, Y-Half,
+				X+Half, Y+Half,
+				X-Half, Y+Half,
+				X-Half, Y-Half,
+				X+Half, Y-Half };
+
+			copy(Ring, Ring + 2 * Points, At);
+			return Points;
+		}
+};
+
+class HexCell
+{
+	public:
+
+		enum { Points = 7 };
+
+		static size_t
+		Emit(const StippleLattice &Lattice, b_coord X, b_coord Y, b_coord *At)
+		{
+			b_coord Side = Lattice.HalfWidth, Tip = Lattice.HalfHeight;
+			b_coord Ring[] = {
+				X+Side, Y-Tip/2,
+				X+Side, Y+Tip/2,
+				X, Y+Tip,
+				X-Side, Y+Tip/2,
+				X-Side, Y-Tip/2,
+				X, Y-Tip,
+				X+Side, Y-Tip/2 };
+
+			copy(Ring, Ring + 2 * Points, At);
+			return Points;
+		}
+};
+
+/// The frames a lattice may be laid out in.  Each turns the points of a
+/// cell from the lattice's frame onto the board.
+
+class UprightFrame
+{
+	public:
+
+		static b_point
+		Board(const StippleLattice &, b_coord X, b_coord Y)
+		{
+			return gtl::construct<b_point>(X, Y);
+		}
+};
+
+class TurnedFrame
+{
+	public:
+
+		static b_point
+		Board(const StippleLattice &Lattice, b_coord X, b_coord Y)
+		{
+			return Lattice.ToBoard(X, Y);
+		}
+};
+
+void
+StippleTile::Calculate()
+{
+	bool Turned = Set->Lattice.Turned();
+
+	// Each pattern's loop is compiled for its own cells, so none of them
+	// costs the others anything.
+	switch (Set->Lattice.Pattern.Cell)  {
+	case StipplePattern::Square:
+		Turned ? Generate<SquareCell, TurnedFrame>() :
+				Generate<SquareCell, UprightFrame>();
+		break;
+	case StipplePattern::Hex:
+		Turned ? Generate<HexCell, TurnedFrame>() :
+				Generate<HexCell, UprightFrame>();
+		break;
+	default:
+		Turned ? Generate<DiamondCell, TurnedFrame>() :
+				Generate<DiamondCell, UprightFrame>();
+		break;
+	}
+
+	PhaseClock Clock;
+	b_polygon_set Outline(1, *Set->Outline);
+	foreach(size_t Keepout, Keepouts)  {
+		Overlays.push_back(Set->Backend->Intersect(
+				b_polygon_set(1, (*Set->Components)[Keepout]), Outline));
+	}
+	Clock.Charge(Times, OverlayPhase);
+}
+
+template <class Cell, class Frame>
+void
+StippleTile::Generate()
+{
+	PhaseClock Clock;
+	b_polygon Polygon;
+	b_polygon_set Stipple;
+	const StippleLattice &Lattice = Set->Lattice;
+	b_coord HalfWidth = Lattice.HalfWidth;
+	b_coord Corners[2 * Cell::Points];
+	b_point Points[Cell::Points];
+
+	// Only the container edges which reach this tile's rows can touch it.
+	vector<b_segment> Edges;
+	b_coord Slack = Lattice.Turned() ? 2 : 0;
+	b_coord Top = Lattice.RowY(FirstRow) - Lattice.HalfHeight - Slack;
+	b_coord Bottom = Lattice.RowY(LastRow - 1) + Lattice.HalfHeight + Slack;
+	foreach(const b_segment &Edge, Set->Edges)  {
+		if (max(gtl::y(gtl::low(Edge)), gtl::y(gtl::high(Edge))) >= Top &&
+			min(gtl::y(gtl::low(Edge)), gtl::y(gtl::high(Edge))) <= Bottom)  {
+			Edges.push_back(Edge);
+		}
+	}
+
+	vector<double> Crossings;
+	vector<b_span> Boundary;
+
+	for (int Row = FirstRow; Row < LastRow; Row++)  {
+
+		b_coord Y = Lattice.RowY(Row);
+		size_t Crossing = 0, Span = 0;
+
+		ClassifyRow(Edges, Y, Crossings, Boundary);
+
+		for (int Column = FirstColumn; Column < LastColumn; Column++)  {
+
+			b_coord X = Lattice.ColumnX(Row, Column);
+
+			// The rows which are not inset are one cell shorter.
+			if (X >= xh(Lattice.Extents) + Lattice.Dx)  {
+				break;
+			}
+
+			while (Crossing < Crossings.size() && Crossings[Crossing] < X)  {
+				++Crossing;
+			}
+			while (Span < Boundary.size() &&
+					Boundary[Span].second < X - HalfWidth)  {
+				++Span;
+			}
+
+			bool Clear = Span == Boundary.size() ||
+					Boundary[Span].first > X + HalfWidth;
+
+			// No edge comes near a clear cell, so it is either wholly
+			// outside the container and dropped, or wholly inside and
+			// emitted just as the intersection would have emitted it.
+			if (Clear && !(Crossing % 2))  {
+				continue;
+			}
+
+			size_t PointN = Cell::Emit(Lattice, X, Y, Corners);
+			for (size_t p = 0; p < PointN; p++)  {
+				Points[p] = Frame::Board(
+						Lattice, Corners[2 * p], Corners[2 * p + 1]);
+			}
+
+			if (Clear)  {
+				CutOuts.Add(Points, Points + PointN);
+			} else  {
+				gtl::set_points(Polygon, Points, Points + PointN - 1);
+				Stipple.push_back(Polygon);
+			}
+		}
+	}
+
+	Clock.Charge(Times, LatticePhase);
+
+	// Only the cells on the container's edge need the boolean
+	// intersection, which is the expensive operation.
+	if (!Stipple.empty())  {
+		b_polygon_set Clipped = Set->Backend->Intersect(Stipple, Set->Container);
+		foreach(const b_polygon &CutOut, Clipped)  {
+			CutOuts.Add(CutOut);
+		}
+	}
+	Clock.Charge(Times, ContainerPhase);
+}
+
+/// Append each edge of a closed ring of points to a list of segments.
+template <class Iterator>
+static void
+AddEdges(Iterator First, Iterator Last, vector<b_segment> &Edges)
+{
+	for (Iterator iPoint = First; iPoint != Last; ++iPoint)  {
+		Iterator iNext = iPoint;
+		if (++iNext == Last)  {
+			iNext = First;
+		}
+		Edges.push_back(b_segment(*iPoint, *iNext));
+	}
+}
+
+void
+StippleTileSet::Plan(const b_polygon &Outline, const b_polygon_set &Components,
+		const vector<size_t> &Candidates, b_coord Trace, b_coord Pitch,
+		const BooleanBackend &Backend, const StipplePattern &Pattern)
+{
+	gtl::rectangle_data<b_coord> Extents;
+
+	boost::polygon::extents(Extents, Outline);
+	Lattice.Plan(Extents, Trace, Pitch, Pattern);
+	this->Outline = &Outline;
+	this->Components = &Components;
+	this->Backend = &Backend;
+
+	// Set up the bounding rectangle for the unionized set.
+	// Shrink it to expose the perimeter and to expose a margin
+	// around each cut-out used to outline the pattern.
+	Container = Backend.Resize(b_polygon_set(1, Outline), -Trace);
+
+	// Gather the container's edges so the tiles can classify whole
+	// spans of cells without any boolean operations.
+	foreach(const b_polygon &Polygon, Container)  {
+		AddEdges(Polygon.begin(), Polygon.end(), Edges);
+		for (polygon_with_holes_traits<b_polygon>::iterator_holes_type
+				iHole = Polygon.begin_holes();
+				iHole != Polygon.end_holes(); ++iHole)  {
+			AddEdges(iHole->begin(), iHole->end(), Edges);
+		}
+	}
+	if (Lattice.Turned())  {
+		foreach(b_segment &Edge, Edges)  {
+			b_point Low = gtl::low(Edge), High = gtl::high(Edge);
+			Edge = b_segment(Lattice.ToLattice(gtl::x(Low), gtl::y(Low)),
+					Lattice.ToLattice(gtl::x(High), gtl::y(High)));
+		}
+	}
+
+	// Cut the lattice into tiles, in row-major order.
+	int TileRowCount = (Lattice.Rows + TileRows - 1) / TileRows;
+	int TileColumnCount = (Lattice.Columns + TileColumns - 1) / TileColumns;
+
+	Tiles.resize(TileRowCount * TileColumnCount);
+	for (int t = 0; t < (int)Tiles.size(); t++)  {
+		StippleTile &Tile = Tiles[t];
+		Tile.Set = this;
+		Tile.FirstRow = (t / TileColumnCount) * TileRows;
+		Tile.LastRow = min(Tile.FirstRow + TileRows, Lattice.Rows);
+		Tile.FirstColumn = (t % TileColumnCount) * TileColumns;
+		Tile.LastColumn = min(Tile.FirstColumn + TileColumns, Lattice.Columns);
+	}
+
+	// Each keepout which might touch the union goes to the tile under
+	// the center of its extents, so that it is intersected just once.
+	foreach(size_t k, Candidates)  {
+
+		gtl::rectangle_data<b_coord> KeepoutExtents;
+		boost::polygon::extents(KeepoutExtents, Components[k]);
+
+		b_point Center = gtl::construct<b_point>(
+				(xl(KeepoutExtents) + xh(KeepoutExtents)) / 2,
+				(yl(KeepoutExtents) + yh(KeepoutExtents)) / 2);
+		if (Lattice.Turned())  {
+			Center = Lattice.ToLattice(gtl::x(Center), gtl::y(Center));
+		}
+
+		b_coord Row = (gtl::y(Center) - Lattice.Y0) / Lattice.Dy;
+		b_coord Column = (gtl::x(Center) - Lattice.X0) / Lattice.Dx;
+		Row = max((b_coord)0, min(Row, (b_coord)Lattice.Rows - 1));
+		Column = max((b_coord)0, min(Column, (b_coord)Lattice.Columns - 1));
+
+		Tiles[(Row / TileRows) * TileColumnCount +
+				Column / TileColumns].Keepouts.push_back(k);
+	}
+}
+
+void
+StippleTileSet::Calculate()
+{
+	foreach(StippleTile &Tile, Tiles)  {
+		Tile.Calculate();
+	}
+}
+
+void
+StippleTileSet::Stitch(StippledPolygon &Stippled) const
+{
+	// The diamonds never overlap, so their cutouts are simply gathered,
+	// but the overlays are merged, gathered in keepout order so that the
+	// result does not depend upon how the union was tiled.
+	vector< pair<size_t, const b_polygon_set *> > Overlays;
+	b_polygon_set Gathered;
+	PhaseClock Clock;
+
+	size_t Rings = 0, Points = 0;
+	foreach(const StippleTile &Tile, Tiles)  {
+		Rings += Tile.CutOuts.Size();
+		Points += Tile.CutOuts.Points();
+	}
+
+	Stippled.Outline = *Outline;
+	Stippled.CutOuts.Reserve(Rings, Points);
+	foreach(const StippleTile &Tile, Tiles)  {
+		Stippled.Times.Add(Tile.Times);
+		Stippled.CutOuts.Append(Tile.CutOuts);
+		for (size_t k = 0; k < Tile.Keepouts.size(); k++)  {
+			Overlays.push_back(make_pair(Tile.Keepouts[k], &Tile.Overlays[k]));
+		}
+	}
+
+	sort(Overlays.begin(), Overlays.end());
+	for (size_t k = 0; k < Overlays.size(); k++)  {
+		Gathered.insert(Gathered.end(),
+				Overlays[k].second->begin(), Overlays[k].second->end());
+	}
+	if (!Gathered.empty())  {
+		Stippled.Overlays = Backend->Union(Gathered);
+	}
+	Clock.Charge(Stippled.Times, StitchPhase);
+}
+
+StippledPolygon
+StippleUnion(const b_polygon &Outline,
+		const b_polygon_set &Keepouts, b_coord Trace, b_coord Pitch,
+		const BooleanBackend &Backend, const StipplePattern &Pattern)
+{
+	StippleTileSet Set;
+	StippledPolygon Stippled;
+	vector<size_t> Candidates;
+	gtl::rectangle_data<b_coord> Extents, KeepoutExtents;
+
+	boost::polygon::extents(Extents, Outline);
+	for (size_t k = 0; k < Keepouts.size(); k++)  {
+		boost::polygon::extents(KeepoutExtents, Keepouts[k]);
+		if (gtl::intersects(Extents, KeepoutExtents))  {
+			Candidates.push_back(k);
+		}
+	}
+
+	Set.Plan(Outline, Keepouts, Candidates, Trace, Pitch, Backend, Pattern);
+	Set.Calculate();
+	Set.Stitch(Stippled);
+	return Stippled;
+}
+
+/// The side of a cut through Extents, as a quadrilateral reaching past
+/// Extents on that side.  Across cuts the line x + y = Cut, and the rest
+/// x - y = Cut, each of which passes through integer points only.
+static b_polygon
+HalfPlane(b_coord Cut, bool Across, bool Below,
+		const gtl::rectangle_data<b_coord> &Extents)
+{
+	b_coord Reach = (xh(Extents) - xl(Extents)) + (yh(Extents) - yl(Extents));
+	b_coord t0 = xl(Extents) - Reach, t1 = xh(Extents) + Reach;
+	b_coord Dx = Below ? -Reach : Reach;
+	b_coord Dy = Across ? Dx : -Dx;
+	vector<b_point> Corners;
+
+	if (Across)  {
+		Corners.push_back(b_point(t0, Cut - t0));
+		Corners.push_back(b_point(t1, Cut - t1));
+		Corners.push_back(b_point(t1 + Dx, Cut - t1 + Dy));
+		Corners.push_back(b_point(t0 + Dx, Cut - t0 + Dy));
+	} else  {
+		Corners.push_back(b_point(t0, t0 - Cut));
+		Corners.push_back(b_point(t1, t1 - Cut));
+		Corners.push_back(b_point(t1 + Dx, t1 - Cut + Dy));
+		Corners.push_back(b_point(t0 + Dx, t0 - Cut + Dy));
+	}
+
+	b_polygon Half;
+	gtl::set_points(Half, Corners.begin(), Corners.end());
+	return Half;
+}
+
+/// The state shared by every level of a split.
+class StippleSplit
+{
+	public:
+
+		const StippledPolygon *Stippled;
+		const BooleanBackend *Backend;
+		gtl::rectangle_data<b_coord> Extents;
+		b_coord Spacing;
+		size_t Budget;
+
+		/// The center of each cutout, in x + y and x - y.
+		vector< pair<double, double> > Centers;
+
+		vector<StippledPiece> Pieces;
+
+		/// Set when a cutout lay in no part of its outline.
+		bool Stray;
+
+		/// Cut Outline, which holds the given cutouts, in two until each
+		/// part is within the budget.
+		void Split(const b_polygon_set &Outline, const vector<size_t> &CutOuts);
+
+		/// Hand each cutout to the part of Outline it lies in.
+		void Finish(const b_polygon_set &Outline, const vector<size_t> &CutOuts);
+};
+
+void
+StippleSplit::Split(const b_polygon_set &Outline, const vector<size_t> &CutOuts)
+{
+	if (Outline.empty())  {
+		Finish(Outline, CutOuts);
+		return;
+	}
+
+	double ULow = HUGE_VAL, UHigh = -HUGE_VAL;
+	double VLow = HUGE_VAL, VHigh = -HUGE_VAL;
+	foreach(size_t c, CutOuts)  {
+		ULow = min(ULow, Centers[c].first);
+		UHigh = max(UHigh, Centers[c].first);
+		VLow = min(VLow, Centers[c].second);
+		VHigh = max(VHigh, Centers[c].second);
+	}
+
+	// Cut across the longer spread of cutouts, on the web nearest its
+	// middle.  Cutouts from one diamond, where the container split it, can
+	// not be parted, so a spread of less than a diamond is left alone.
+	bool Across = UHigh - ULow >= VHigh - VLow;
+	double Low = Across ? ULow : VLow, High = Across ? UHigh : VHigh;
+	if (CutOuts.size() <= Budget || High - Low < Spacing / 2)  {
+		Finish(Outline, CutOuts);
+		return;
+	}
+	b_coord Cut = Spacing * (b_coord)floor((Low + High) / 2 / Spacing + 0.5);
+
+	vector<size_t> Below, Above;
+	foreach(size_t c, CutOuts)  {
+		(((Across ? Centers[c].first : Centers[c].second) < Cut) ?
+				Below : Above).push_back(c);
+	}
+
+	// Pieces of one clipped diamond, off the lattice, can all land on one
+	// side of the web, and cutting again would find the same web.
+	if (Below.empty() || Above.empty())  {
+		Finish(Outline, CutOuts);
+		return;
+	}
+
+	Split(Backend->Intersect(Outline,
+			b_polygon_set(1, HalfPlane(Cut, Across, true, Extents))), Below);
+	Split(Backend->Intersect(Outline,
+			b_polygon_set(1, HalfPlane(Cut, Across, false, Extents))), Above);
+}
+
+void
+StippleSplit::Finish(const b_polygon_set &Outline, const vector<size_t> &CutOuts)
+{
+	size_t First = Pieces.size();
+
+	foreach(const b_polygon &Part, Outline)  {
+		Pieces.push_back(StippledPiece());
+		Pieces.back().Outline = Part;
+	}
+
+	// The cutouts lie well within the outline, so any of their points
+	// tells which part they are in.
+	foreach(size_t c, CutOuts)  {
+		size_t p = First;
+		while (p < Pieces.size() && !gtl::contains(
+				Pieces[p].Outline, *Stippled->CutOuts.Begin(c)))  {
+			p++;
+		}
+		if (p == Pieces.size())  {
+			Stray = true;
+			return;
+		}
+		Pieces[p].CutOuts.push_back(c);
+	}
+}
+
+vector<StippledPiece>
+SplitStippledPolygon(const StippledPolygon &Stippled,
+		b_coord Spacing, size_t Budget, const BooleanBackend &Backend)
+{
+	StippleSplit Split;
+	vector<size_t> CutOuts(Stippled.CutOuts.Size());
+	b_polygon Outer;
+
+	Split.Stippled = &Stippled;
+	Split.Backend = &Backend;
+	Split.Spacing = Spacing;
+	Split.Budget = max(Budget, (size_t)1);
+	gtl::set_points(Outer, Stippled.Outline.begin(), Stippled.Outline.end());
+	boost::polygon::extents(Split.Extents, Outer);
+
+	for (size_t r = 0; r < CutOuts.size(); r++)  {
+		gtl::rectangle_data<b_coord> Box;
+		RingSet::iterator_type iPoint = Stippled.CutOuts.Begin(r);
+
+		Box = gtl::rectangle_data<b_coord>(gtl::x(*iPoint), gtl::y(*iPoint),
+				gtl::x(*iPoint), gtl::y(*iPoint));
+		for (; iPoint != Stippled.CutOuts.End(r); ++iPoint)  {
+			gtl::encompass(Box, *iPoint);
+		}
+		double X = (xl(Box) + xh(Box)) / 2.0, Y = (yl(Box) + yh(Box)) / 2.0;
+		Split.Centers.push_back(make_pair(X + Y, X - Y));
+		CutOuts[r] = r;
+	}
+
+	Split.Stray = false;
+	Split.Split(b_polygon_set(1, Outer), CutOuts);
+	if (Split.Stray)  {
+		Split.Pieces.clear();
+	}
+	return Split.Pieces;
+}
+
+size_t
+FlatPointCount(const b_polygon &Outline, const RingSet &Rings,
+		const vector<size_t> &CutOuts)
+{
+	size_t PointN = Outline.size() - 1;
+	foreach(size_t r, CutOuts)  {
+		PointN += Rings.End(r) - Rings.Begin(r);
+	}
+	return PointN;
+}
+
+/// The polygons merged by each leaf of a UnionReduction.
+static const size_t LeafSize = 16;
+
+/// The root of Item's group, halving the path to it on the way up.
+static size_t
+FindGroup(vector<size_t> &Roots, size_t Item)
+{
+	while (Roots[Item] != Item)  {
+		Roots[Item] = Roots[Roots[Item]];
+		Item = Roots[Item];
+	}
+	return Item;
+}
+
+void
+UnionReduction::Plan(const b_polygon_set &Set, const BooleanBackend &Backend)
+{
+	vector<b_keepout_entry> Entries;
+	vector<size_t> Roots(Set.size());
+	gtl::rectangle_data<b_coord> Extents;
+
+	this->Backend = &Backend;
+	Source = &Set;
+	Members.clear();
+	Parts.clear();
+	Merged.clear();
+	Jobs.clear();
+
+	for (size_t p = 0; p < Set.size(); p++)  {
+		boost::polygon::extents(Extents, Set[p]);
+		Entries.push_back(b_keepout_entry(b_box(
+				b_corner(xl(Extents), yl(Extents)),
+				b_corner(xh(Extents), yh(Extents))), p));
+		Roots[p] = p;
+	}
+
+	// Join every pair of polygons whose extents meet, touching included,
+	// since touching polygons merge into one region.
+	b_keepout_index Index(Entries.begin(), Entries.end());
+	foreach(const b_keepout_entry &Entry, Entries)  {
+		vector<b_keepout_entry> Neighbors;
+		Index.query(bgi::intersects(Entry.first), back_inserter(Neighbors));
+		foreach(const b_keepout_entry &Neighbor, Neighbors)  {
+			size_t A = FindGroup(Roots, Entry.second);
+			size_t B = FindGroup(Roots, Neighbor.second);
+			// The lower index wins, so groups keep the order of Set.
+			Roots[max(A, B)] = min(A, B);
+		}
+	}
+
+	// Number the groups by their first polygon.  The leaves read their
+	// polygons straight from Set, so none is copied until it is merged.
+	vector<size_t> Group(Set.size());
+	for (size_t p = 0; p < Set.size(); p++)  {
+		size_t Root = FindGroup(Roots, p);
+		if (Root == p)  {
+			Group[p] = Members.size();
+			Members.push_back(vector<size_t>());
+		} else {
+			Group[p] = Group[Root];
+		}
+		Members[Group[p]].push_back(p);
+	}
+	Parts.resize(Members.size());
+
+	// Even a lone polygon is merged once, to come out as a region.
+	PlanLevel(LeafSize, true);
+}
+
+void
+UnionReduction::PlanLevel(size_t Fanin, bool Leaves)
+{
+	this->Fanin = Fanin;
+	this->Leaves = Leaves;
+	Jobs.clear();
+	Merged.assign(Parts.size(), vector<b_polygon_set>());
+	for (size_t g = 0; g < Parts.size(); g++)  {
+		size_t Count = Leaves ? Members[g].size() : Parts[g].size();
+
+		// A group down to one part is done, and carried up as it is.
+		if (Count < 2 && !Leaves)  {
+			Merged[g].swap(Parts[g]);
+			continue;
+		}
+		for (size_t First = 0; First < Count; First += Fanin)  {
+			Job Next = {g, First, min(First + Fanin, Count)};
+			Jobs.push_back(Next);
+		}
+		Merged[g].resize((Count + Fanin - 1) / Fanin);
+	}
+
+	// Once every group is down to one part, the parts are the result.
+	if (Jobs.empty())  {
+		Parts.swap(Merged);
+	}
+}
+
+size_t
+UnionReduction::Merges() const
+{
+	return Jobs.size();
+}
+
+void
+UnionReduction::Merge(size_t m)
+{
+	const Job &ThisJob = Jobs[m];
+	const vector<b_polygon_set> &Group = Parts[ThisJob.Group];
+	b_polygon_set Gathered;
+
+	for (size_t p = ThisJob.First; p < ThisJob.Last; p++)  {
+		if (Leaves)  {
+			Gathered.push_back((*Source)[Members[ThisJob.Group][p]]);
+		} else {
+			Gathered.insert(Gathered.end(), Group[p].begin(), Group[p].end());
+		}
+	}
+	Merged[ThisJob.Group][ThisJob.First / Fanin] = Backend->Union(Gathered);
+}
+
+void
+UnionReduction::NextLevel()
+{
+	Parts.swap(Merged);
+	PlanLevel(2, false);
+}
+
+void
+UnionReduction::Calculate()
+{
+	while (Merges() > 0)  {
+		for (size_t m = 0; m < Merges(); m++)  {
+			Merge(m);
+		}
+		NextLevel();
+	}
+}
+
+b_polygon_set
+UnionReduction::Result() const
+{
+	b_polygon_set Union;
+
+	foreach(const vector<b_polygon_set> &Group, Parts)  {
+		foreach(const b_polygon_set &Part, Group)  {
+			Union.insert(Union.end(), Part.begin(), Part.end());
+		}
+	}
+	return Union;
+}
+
+size_t
+UnionReduction::Groups() const
+{
+	return Parts.size();
+}
@@ -0,0 +1,813 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file geometry.hpp
+ * \brief The stipple geometry, free of PCB and GTK.
+ *
+ * Everything here takes and returns plain Boost polygons, so it may be
+ * built and measured on its own, as the benchmarks in bench/ do.
+ */
+
+#ifndef GEOMETRY_HPP_
+#define GEOMETRY_HPP_
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/math/constants/constants.hpp>
+#include <boost/polygon/polygon.hpp>
+#include <boost/foreach.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+/// Shorthand for a boost iterator.
+#define foreach BOOST_FOREACH
+
+namespace gtl = boost::polygon;
+
+using namespace std;
+using namespace gtl;
+using namespace boost::polygon::operators;
+
+/// A coordinate, in nanometers.  This is as wide as PCB's own Coord.
+typedef long 													b_coord;
+
+/// A shorthand for a set of coordinates from a boost polygon.
+typedef gtl::polygon_with_holes_data<int> 						b_polygon;
+
+/// A shorthand for boost points (coordinates).
+typedef gtl::polygon_traits<b_polygon>::point_type 				b_point;
+
+/// A shorthand for the boost polygon holes.
+typedef gtl::polygon_with_holes_traits<b_polygon>::hole_type 	b_hole;
+
+/// A shorthand for a boost collection of polygons.
+typedef std::vector<b_polygon> 									b_polygon_set;
+
+/// A shorthand for a single edge of a boost polygon.
+typedef gtl::segment_data<int> 									b_segment;
+
+/// A shorthand for a span along a lattice row, from left to right.
+typedef std::pair<double, double> 								b_span;
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+/// A shorthand for a boost geometry point in PCB coordinates.
+typedef bg::model::point<b_coord, 2, bg::cs::cartesian> 			b_corner;
+
+/// A shorthand for a boost geometry bounding box in PCB coordinates.
+typedef bg::model::box<b_corner> 								b_box;
+
+/// A keepout's bounding box, and its index in the layer's keepout set.
+typedef std::pair<b_box, size_t> 								b_keepout_entry;
+
+/// A shorthand for the spatial index over a layer's keepouts.
+typedef bgi::rtree<b_keepout_entry, bgi::quadratic<16> > 		b_keepout_index;
+
+/// Used for rounding edges and drawing approximate circles.
+const double PI = boost::math::constants::pi<double>();
+
+/// The number of lattice columns (diamonds per row) handed to one tile.
+const int TileColumns = 16;
+
+/// The number of lattice rows handed to one tile.  Rows are half a pitch
+/// apart, so this keeps each tile roughly square.
+const int TileRows = 32;
+
+/// Return the angle between two points on a plane.
+double Angle2D(int X0, int Y0, int X1, int Y1);
+
+/// Using a finite number of line segments, approximate a circle.
+b_polygon MakeCircularOverlay(
+		b_coord x, b_coord y, b_coord Radius, int SegmentCount = 24);
+
+/// Remove a square inset from a polygon.
+b_polygon MakeRectangularOverlay(
+		b_coord x0, b_coord y0, b_coord x1, b_coord y1, b_coord Thickness);
+
+/// Make a rounded rectangle, using line segments to approximate the
+/// rounded corners.
+b_polygon MakeRoundedRectangle(
+		int x0, int y0, int x1, int y1, int Radius, int Smoothness);
+
+/// The steps MakeCircularOverlay takes around a circle, worked out once so
+/// that any number of circles may be had by scaling alone.
+class UnitCircle
+{
+	public:
+
+		/// SegmentCount steps to each quarter turn.  A circumscribed circle
+		/// puts its points half a step off the axes and pushes them out,
+		/// so every chord touches the circle and none cuts inside it.
+		UnitCircle(int SegmentCount = 24, bool Circumscribed = false);
+
+		/// The unit circle, in the steps MakeCircularOverlay would take.
+		vector<double> Cos, Sin;
+
+		bool Circumscribed;
+
+		/// The same circle MakeCircularOverlay would make.
+		b_polygon Overlay(b_coord x, b_coord y, b_coord Radius) const;
+
+		/// A rectangle with each corner a quarter of this circle, which
+		/// must be circumscribed.
+		b_polygon RoundedRectangle(b_coord x0, b_coord y0,
+				b_coord x1, b_coord y1, b_coord Radius) const;
+};
+
+/// The corners MakeRoundedRectangle turns, worked out once.
+class UnitCorners
+{
+	public:
+
+		UnitCorners(int Smoothness = 8);
+
+		/// The top right, bottom right, bottom left and top left corners,
+		/// signed so that each point is the corner's center plus Radius
+		/// times these.
+		vector<double> Cos[4], Sin[4];
+
+		/// The same rectangle MakeRoundedRectangle would make.
+		b_polygon Overlay(b_coord x0, b_coord y0,
+				b_coord x1, b_coord y1, b_coord Radius) const;
+};
+
+/// How finely circles and rounded corners are cut into chords.  With a
+/// tolerance, each arc takes just enough steps that no chord strays more
+/// than Tolerance from it, so small holes take few points and large ones
+/// more, and the chords lie outside the arc so a keepout never comes out
+/// smaller than the shape it stands for, bar rounding to the nanometer.
+/// With no tolerance every circle takes the 96 steps it always has.  Once
+/// made, this is only read, so it may be shared between threads.
+class ArcTessellation
+{
+	public:
+
+		ArcTessellation(b_coord Tolerance = 0);
+
+		/// The largest chord error, in nanometers, or zero for fixed steps.
+		b_coord Tolerance;
+
+		/// The steps to each quarter turn of an arc of the given radius.
+		int Segments(b_coord Radius) const;
+
+		/// The unit circle an arc of the given radius is scaled from.
+		const UnitCircle &Steps(b_coord Radius) const;
+
+		/// A circle.
+		b_polygon Circle(b_coord x, b_coord y, b_coord Radius) const;
+
+		/// A rectangle with its corners rounded to Radius.
+		b_polygon RoundedRectangle(b_coord x0, b_coord y0,
+				b_coord x1, b_coord y1, b_coord Radius) const;
+
+	private:
+
+		/// The circle of fixed steps, or the circumscribed circle of each
+		/// segment count up to MaxSegments, indexed by it.
+		vector<UnitCircle> Circles;
+
+		/// The fixed rounded corners.
+		UnitCorners Corners;
+};
+
+/// The fixed tessellation, of 96 steps to a circle.
+const ArcTessellation &DefaultArcs();
+
+/// Add the keepout of a line to Set: a bloated rectangle right over the
+/// line, and a barbell at each end.
+void AddLineOverlay(b_polygon_set &Set,
+		b_coord x0, b_coord y0, b_coord x1, b_coord y1, b_coord Thickness,
+		const ArcTessellation &Arcs = DefaultArcs());
+
+/// The keepout of a pad running from one point to another, grown by Clear
+/// on every side, with corners rounded to Radius.
+b_polygon MakePadOverlay(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+		b_coord Clear, int Radius,
+		const ArcTessellation &Arcs = DefaultArcs());
+
+/// Keepouts gathered to be made in one pass.  Each kind of shape is held
+/// as columns of coordinates, so that the work common to every shape of a
+/// kind runs down plain arrays the compiler may vectorize.  Arcs come from
+/// the tessellation's tables, lines need no trigonometry at all, and runs
+/// of shapes of one radius look up its steps only once.
+class OverlayBatch
+{
+	public:
+
+		/// A circle, as ArcTessellation::Circle would make it.
+		void AddCircle(b_coord x, b_coord y, b_coord Radius);
+
+		/// A line, as AddLineOverlay would add it.
+		void AddLine(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+				b_coord Thickness);
+
+		/// A pad, as MakePadOverlay would make it.
+		void AddPad(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+				b_coord Clear, b_coord Radius);
+
+		/// The keepout of a via or pin: its copper and clearance, with
+		/// the trace of the stipple around them.  With no trace it is just
+		/// the clearance the object itself asks for.
+		void AddHoleKeepout(b_coord x, b_coord y, b_coord Thickness,
+				b_coord Clearance, b_coord Trace);
+
+		/// The keepout of a line, as for a hole.
+		void AddLineKeepout(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+				b_coord Thickness, b_coord Clearance, b_coord Trace);
+
+		/// The keepout of a pad, as for a hole, its corners rounded by the
+		/// clearance and trace alone.
+		void AddPadKeepout(b_coord x0, b_coord y0, b_coord x1, b_coord y1,
+				b_coord Thickness, b_coord Clearance, b_coord Trace);
+
+		/// The number of polygons Generate will add.
+		size_t Size() const;
+
+		void Clear();
+
+		/// Add every keepout to Set: the circles, then the lines, then the
+		/// pads, each in the order they were added.
+		void Generate(b_polygon_set &Set, const ArcTessellation &Arcs) const;
+
+	private:
+
+		vector<b_coord> CircleX, CircleY, CircleRadius;
+		vector<b_coord> LineX0, LineY0, LineX1, LineY1, LineThickness;
+		vector<b_coord> PadX0, PadY0, PadX1, PadY1, PadClear, PadRadius;
+};
+
+/// A template polygon from PCB's points, or anything else with X and Y
+/// members, its first point repeated at the end as Boost requires.
+template <class Point>
+b_polygon
+ReadTemplatePolygon(const Point *Points, size_t PointN)
+{
+	vector<b_point> EdgeSet;
+
+	for (size_t p = 0; p < PointN; p++)  {
+		EdgeSet.push_back(gtl::construct<b_point>(Points[p].X, Points[p].Y));
+	}
+	if (PointN > 0)  {
+		EdgeSet.push_back(gtl::construct<b_point>(Points[0].X, Points[0].Y));
+	}
+
+	b_polygon Polygon;
+	Polygon.set(EdgeSet.begin(), EdgeSet.end());
+	return Polygon;
+}
+
+/// A 64 bit FNV-1a hash, used to recognize unions whose inputs have not
+/// changed since the last run, and the polygons which were made from them.
+class StippleHash
+{
+	public:
+
+		StippleHash() : Value(14695981039346656037ULL) {}
+
+		/// Fold one more number into the hash.
+		void Add(long long Datum);
+
+		/// Fold in the coordinates of a run of points.
+		template <class Iterator>
+		void Add(Iterator First, Iterator Last)
+		{
+			for ( ; First != Last; ++First)  {
+				Add(gtl::x(*First));
+				Add(gtl::y(*First));
+			}
+		}
+
+		/// The hash as sixteen hex digits.
+		string Hex() const;
+
+		unsigned long long Value;
+};
+
+/// The phases of stippling a layer, in the order they run, as timed for
+/// the run report.
+enum StipplePhase
+{
+	ReadPhase, UnionPhase, LoadPhase, LatticePhase, ContainerPhase,
+	OverlayPhase, StitchPhase, InsertPhase, PhaseCount
+};
+
+/// The name of each phase in the run report.
+extern const char *const PhaseNames[PhaseCount];
+
+/// The wall and CPU seconds spent in each phase.  Tiles' times are summed,
+/// so with several workers a phase may add up to more than the wall time
+/// of its union.
+class PhaseTimes
+{
+	public:
+
+		PhaseTimes();
+
+		/// Add in the times of another union, tile or layer.
+		void Add(const PhaseTimes &Other);
+
+		double Wall[PhaseCount], Cpu[PhaseCount];
+};
+
+/// A stopwatch over the monotonic clock and the calling thread's CPU clock.
+class PhaseClock
+{
+	public:
+
+		PhaseClock();
+
+		/// Charge the time since the last charge, or since the clock was
+		/// made, to a phase.
+		void Charge(PhaseTimes &Times, StipplePhase Phase);
+
+	private:
+
+		double Wall, Cpu;
+};
+
+/// Closed rings of points held end to end in one buffer.  A union's
+/// cutouts run to thousands of small diamonds, and as polygons of their own
+/// each would take an allocation; here a whole union takes two.  Only the
+/// outer ring of a polygon is kept, which is all PCB is given of a cutout.
+class RingSet
+{
+	public:
+
+		typedef vector<b_point>::const_iterator iterator_type;
+
+		RingSet() : Offsets(1, 0)  {}
+
+		/// The number of rings.
+		size_t Size() const  { return Offsets.size() - 1; }
+
+		/// The number of points in every ring together.
+		size_t Points() const  { return Vertices.size(); }
+
+		/// The points of ring r, the first repeated at the end.
+		iterator_type Begin(size_t r) const
+		{
+			return Vertices.begin() + Offsets[r];
+		}
+		iterator_type End(size_t r) const
+		{
+			return Vertices.begin() + Offsets[r + 1];
+		}
+
+		/// Add a ring from a run of points.
+		template <class Iterator>
+		void Add(Iterator First, Iterator Last)
+		{
+			Vertices.insert(Vertices.end(), First, Last);
+			Offsets.push_back(Vertices.size());
+		}
+
+		/// Add the outer ring of a polygon.
+		void Add(const b_polygon &Polygon)
+		{
+			Add(Polygon.begin(), Polygon.end());
+		}
+
+		/// Add every ring of another set.
+		void Append(const RingSet &Other);
+
+		/// Make room for more rings and points, so appending does not
+		/// reallocate.
+		void Reserve(size_t Rings, size_t Points);
+
+		void Clear();
+
+		/// Exchange contents with another set, without copying.
+		void Swap(RingSet &Other);
+
+	private:
+
+		vector<b_point> Vertices;
+
+		/// Where each ring starts in Vertices, and one past the last.
+		vector<size_t> Offsets;
+};
+
+/// A single boost polygon with all of it's cutouts.
+class StippledPolygon
+{
+	public:
+
+		StippledPolygon() : Unchanged(false) {}
+
+		/// The hash of the outline, trace, pitch and nearby keepouts.
+		string Hash;
+
+		/// Set when the layer already holds the polygons for this hash, so
+		/// nothing was calculated and nothing need be inserted.
+		bool Unchanged;
+
+		/// Store the perimeter of a stippled region
+		b_polygon Outline;
+
+		/// Cutouts are the holes in the regions
+		RingSet CutOuts;
+
+		/// Overlays are solid shadows for lines, vias and pads
+		/// which from (with clearance) featured borders within
+		/// stippled areas.
+		b_polygon_set Overlays;
+
+		/// Where the time went, for the run report.  This is not cached.
+		PhaseTimes Times;
+};
+
+/// The boolean operations the stipple is made with, so the engine beneath
+/// them may be chosen at run time.  Polygons go in and come out as
+/// boost::polygon holds them, and every result is a set of disjoint regions.
+class BooleanBackend
+{
+	public:
+
+		virtual ~BooleanBackend()  {}
+
+		/// The name the backend is chosen by.
+		virtual const char *Name() const = 0;
+
+		/// The regions covered by any polygon of Set.
+		virtual b_polygon_set Union(const b_polygon_set &Set) const = 0;
+
+		/// The regions covered by both A and B.
+		virtual b_polygon_set Intersect(
+				const b_polygon_set &A, const b_polygon_set &B) const = 0;
+
+		/// Set grown by Distance on every side, or shrunk if it is negative.
+		virtual b_polygon_set Resize(
+				const b_polygon_set &Set, b_coord Distance) const = 0;
+};
+
+/// boost::polygon, exact on integer coordinates, which the stipple has
+/// always used.
+class PolygonBackend : public BooleanBackend
+{
+	public:
+
+		const char *Name() const;
+		b_polygon_set Union(const b_polygon_set &Set) const;
+		b_polygon_set Intersect(
+				const b_polygon_set &A, const b_polygon_set &B) const;
+		b_polygon_set Resize(const b_polygon_set &Set, b_coord Distance) const;
+};
+
+/// boost::geometry, which works in doubles and rounds its results back to
+/// the nanometer.  Resizing leaves mitered corners, as boost::polygon does.
+class GeometryBackend : public BooleanBackend
+{
+	public:
+
+		const char *Name() const;
+		b_polygon_set Union(const b_polygon_set &Set) const;
+		b_polygon_set Intersect(
+				const b_polygon_set &A, const b_polygon_set &B) const;
+		b_polygon_set Resize(const b_polygon_set &Set, b_coord Distance) const;
+};
+
+/// The backend of the given name, ignoring case, or NULL if there is none.
+/// An empty name is the default, boost::polygon.
+const BooleanBackend *FindBackend(const string &Name);
+
+/// The default backend.
+const BooleanBackend &DefaultBackend();
+
+/// The names of the backends, the default first.
+vector<string> BackendNames();
+
+/// The union of many polygons, reduced as a balanced tree of merges.
+/// Polygons are first grouped by their extents, so polygons which can not
+/// touch are never merged together, and each group is then merged in
+/// leaves of a few polygons and in pairs above them, one level at a time.
+/// The merges of a level write to slots of their own, so they may run on
+/// any thread, in any order.
+class UnionReduction
+{
+	public:
+
+		/// Group Set by its extents and plan the leaves.  Set is read by
+		/// the first level of merges, so must outlive it.
+		void Plan(const b_polygon_set &Set,
+				const BooleanBackend &Backend = DefaultBackend());
+
+		/// The number of merges in the current level, zero once reduced.
+		size_t Merges() const;
+
+		/// Do merge m of the current level.
+		void Merge(size_t m);
+
+		/// Move on to the next level, once every merge of this one is done.
+		void NextLevel();
+
+		/// Reduce every level on the calling thread.
+		void Calculate();
+
+		/// The regions of every group, in the order of their first polygon.
+		b_polygon_set Result() const;
+
+		/// The number of groups Set fell into.
+		size_t Groups() const;
+
+	private:
+
+		/// A run of the parts of one group, merged into one part.
+		struct Job
+		{
+			size_t Group, First, Last;
+		};
+
+		/// Plan the jobs of a level, Fanin parts to a job.  Every group
+		/// is merged at the Leaves, even one of a single part.
+		void PlanLevel(size_t Fanin, bool Leaves);
+
+		/// The polygons being merged, and the indices of each group's.
+		const b_polygon_set *Source;
+		vector< vector<size_t> > Members;
+
+		/// The parts of each group still to be merged, and the slots the
+		/// current level writes them to.
+		vector< vector<b_polygon_set> > Parts, Merged;
+
+		vector<Job> Jobs;
+		size_t Fanin;
+		bool Leaves;
+		const BooleanBackend *Backend;
+};
+
+/// The shape of a stipple's cutouts, and the angle its lattice is turned
+/// by.  In every pattern the webs between neighbouring cutouts are a trace
+/// wide, and their centers a pitch apart.
+class StipplePattern
+{
+	public:
+
+		enum Shape { Diamond, Square, Hex, ShapeCount };
+
+		StipplePattern(Shape Cell = Diamond, double Angle = 0)
+			: Cell(Cell), Angle(Angle)  {}
+
+		Shape Cell;
+
+		/// Degrees counterclockwise, for hatching bend zones across the
+		/// bend.  Zero keeps the lattice square to the board.
+		double Angle;
+
+		bool Turned() const  { return Angle != 0; }
+
+		/// The name of a shape, which it is chosen by.
+		static const char *Name(Shape Cell);
+
+		/// Set Cell to the shape of the given name, ignoring case, or
+		/// return false if there is none.
+		bool Choose(const string &Name);
+};
+
+/// The lattice of cells laid over one union, in rows.  Every cell center is
+/// addressed by a row and a column, so the extents may be cut into tiles
+/// without any cell being produced twice or lost at a seam.  A turned
+/// pattern is laid out in a frame of its own, turned by its angle, so that
+/// its rows still run along x.
+class StippleLattice
+{
+	public:
+
+		StipplePattern Pattern;
+
+		/// The distance between cell centers along a row, and between rows.
+		b_coord Dx, Dy;
+
+		/// How far even rows are moved left of odd ones.
+		b_coord Inset;
+
+		/// Half the width and height of a cutout.
+		b_coord HalfWidth, HalfHeight;
+
+		/// The area to be covered by the lattice, in its frame.
+		gtl::rectangle_data<b_coord> Extents;
+
+		/// The center of the cell in row zero, column zero, before the
+		/// every-other-row inset is applied.
+		b_coord X0, Y0;
+
+		/// The size of the lattice, in rows and (the widest row's) columns.
+		int Rows, Columns;
+
+		/// The cosine and sine of the pattern's angle.
+		double Cos, Sin;
+
+		/// Size the lattice for the given extents, on the board, trace and
+		/// pitch.
+		void Plan(gtl::rectangle_data<b_coord> Area, b_coord Trace, b_coord Pitch,
+				const StipplePattern &Pattern = StipplePattern());
+
+		/// The Dx of a diamond lattice for the given trace and pitch.
+		static b_coord Spacing(b_coord Trace, b_coord Pitch);
+
+		/// True if the lattice's frame is turned from the board's.
+		bool Turned() const  { return Pattern.Turned(); }
+
+		/// A point of the board in the lattice's frame, and back.
+		b_point ToLattice(double X, double Y) const;
+		b_point ToBoard(double X, double Y) const;
+
+		/// The vertical center of a row.
+		b_coord RowY(int Row) const;
+
+		/// The horizontal center of a cell within a row.  Even rows are
+		/// inset to form the mosaic pattern.
+		b_coord ColumnX(int Row, int Column) const;
+};
+
+class StippleTileSet;
+
+/// A lattice-aligned block of rows and columns from one union, with all of
+/// the work needed to stipple it.  Tiles may run on any thread, as they
+/// only read the union's shared state.
+class StippleTile
+{
+	public:
+
+		/// The tile set this tile reports back to.
+		StippleTileSet *Set;
+
+		/// The first row and column of the tile, and one past the last.
+		int FirstRow, LastRow, FirstColumn, LastColumn;
+
+		/// The indices of the keepouts assigned to this tile.
+		vector<size_t> Keepouts;
+
+		/// The diamonds of this tile, clipped to the container.
+		RingSet CutOuts;
+
+		/// Each assigned keepout intersected with the union, in the order
+		/// of Keepouts.
+		vector<b_polygon_set> Overlays;
+
+		/// The lattice, container and overlay times of this tile.
+		PhaseTimes Times;
+
+		/// Find where the container's edges meet one lattice row.  Crossings
+		/// receives, in order, every point where the row's center line
+		/// crosses an edge, so a diamond is inside when an odd number of them
+		/// lie to its left.  Boundary receives the disjoint spans, in order,
+		/// where an edge passes through the band of the row's diamonds.
+		void ClassifyRow(const vector<b_segment> &Edges, b_coord Y,
+				vector<double> &Crossings, vector<b_span> &Boundary);
+
+		/// Generate, clip and intersect this tile's share of the union.
+		void Calculate();
+
+	private:
+
+		/// Generate this tile's cells of the given shape, in the given
+		/// frame, keeping those wholly inside the container and clipping
+		/// those on its edge.
+		template <class Cell, class Frame>
+		void Generate();
+};
+
+/// All of the tiles of one union, and the read-only state they share.
+class StippleTileSet
+{
+	public:
+
+		/// The lattice laid over the union.
+		StippleLattice Lattice;
+
+		/// The union itself.
+		const b_polygon *Outline;
+
+		/// The union shrunk by the trace width, which clips the diamonds.
+		b_polygon_set Container;
+
+		/// Every edge of the container, outlines and holes alike, in the
+		/// lattice's frame.
+		vector<b_segment> Edges;
+
+		/// Every keepout for the layer.
+		const b_polygon_set *Components;
+
+		/// The engine for the clipping, shrinking and merging.
+		const BooleanBackend *Backend;
+
+		/// The tiles, in row-major order.
+		vector<StippleTile> Tiles;
+
+		/// Lay the lattice over Outline, shrink it to the container, and
+		/// cut it into tiles.  Each of the Candidates, indices of keepouts
+		/// in Components which might touch Outline, goes to the tile under
+		/// the center of its extents, so it is intersected just once.
+		void Plan(const b_polygon &Outline, const b_polygon_set &Components,
+				const vector<size_t> &Candidates, b_coord Trace, b_coord Pitch,
+				const BooleanBackend &Backend = DefaultBackend(),
+				const StipplePattern &Pattern = StipplePattern());
+
+		/// Calculate every tile on the calling thread.
+		void Calculate();
+
+		/// Gather the finished tiles, and their times, into the stippled
+		/// union.
+		void Stitch(StippledPolygon &Stippled) const;
+};
+
+/// Stipple one union on the calling thread, against every keepout whose
+/// extents reach it.
+StippledPolygon StippleUnion(const b_polygon &Outline,
+		const b_polygon_set &Keepouts, b_coord Trace, b_coord Pitch,
+		const BooleanBackend &Backend = DefaultBackend(),
+		const StipplePattern &Pattern = StipplePattern());
+
+/// One piece of a split union: part of its outline, and the cutouts which
+/// lie within it, by their index in the union's CutOuts.
+class StippledPiece
+{
+	public:
+
+		b_polygon Outline;
+		vector<size_t> CutOuts;
+};
+
+/// Cut a stippled union into pieces of no more than Budget cutouts each, so
+/// that no one polygon given to PCB carries thousands of holes.  The cuts
+/// are 45 degree lines through the webs between diamonds, which lie on
+/// multiples of the lattice's Spacing in x + y and in x - y and never touch
+/// a cutout, so every cutout falls within one piece and the pieces cover
+/// just what the outline did.  Only the outer ring of the outline is cut,
+/// as only it is given to PCB.  Should some cutout lie in no piece, no
+/// pieces are returned and the union is best given whole.
+vector<StippledPiece> SplitStippledPolygon(const StippledPolygon &Stippled,
+		b_coord Spacing, size_t Budget,
+		const BooleanBackend &Backend = DefaultBackend());
+
+/// The number of points FlattenStippled writes for an outline and cutouts.
+size_t FlatPointCount(const b_polygon &Outline, const RingSet &Rings,
+		const vector<size_t> &CutOuts);
+
+/// Flatten an outline and the given cutouts of Rings into one run of points,
+/// as PCB holds a polygon with holes, noting in HoleIndex where each hole
+/// starts.  The closing point Boost repeats on the outline is left out, and
+/// the cutouts' rings carry none.  Points must have room for FlatPointCount
+/// of them and HoleIndex for one per cutout.
+template <class Point, class Index>
+void
+FlattenStippled(const b_polygon &Outline, const RingSet &Rings,
+		const vector<size_t> &CutOuts, Point *Points, Index *HoleIndex)
+{
+	Point *Next = Points;
+
+	b_polygon::iterator_type iOutline = Outline.begin();
+	for (size_t n = 0; n + 1 < Outline.size(); n++, ++iOutline, ++Next)  {
+		Next->X = gtl::x(*iOutline);
+		Next->Y = gtl::y(*iOutline);
+	}
+
+	for (size_t h = 0; h < CutOuts.size(); h++)  {
+		HoleIndex[h] = Next - Points;
+		for (RingSet::iterator_type iPoint = Rings.Begin(CutOuts[h]);
+				iPoint != Rings.End(CutOuts[h]); ++iPoint, ++Next)  {
+			Next->X = gtl::x(*iPoint);
+			Next->Y = gtl::y(*iPoint);
+		}
+	}
+}
+
+/// Copy an overlay's ring into Points just as it is, closing point and all,
+/// as overlays are given to PCB.
+template <class Point>
+void
+FlattenOverlay(const b_polygon &Overlay, Point *Points)
+{
+	for (b_polygon::iterator_type iPoint = Overlay.begin();
+			iPoint != Overlay.end(); ++iPoint, ++Points)  {
+		Points->X = gtl::x(*iPoint);
+		Points->Y = gtl::y(*iPoint);
+	}
+}
+
+#endif /* GEOMETRY_HPP_ */
@@ -0,0 +1,212 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file gerber.cpp
+ * \brief Gerber export of the stipple layers.
+ *
+ * Regions may not have holes of their own, so the cutouts are cleared out
+ * of their outline by regions of clear polarity.  The unions of a layer
+ * never overlap, so a cutout only ever clears its own union, and the
+ * overlays, drawn dark after it, fill back in what they cover.  Last, the
+ * clearances of the objects are cleared from the outline and overlays
+ * alike, which on the board PCB does to the polygons itself.
+ */
+
+#include "stipple.hpp"
+
+string GerberFile;
+
+/// The bytes gathered before each write to the file.
+static const size_t GerberBuffer = 1 << 16;
+
+GerberWriter::GerberWriter()
+	: Out(NULL), Failed(false), Buffer(GerberBuffer), Used(0),
+	  Height(0), LastX(0), LastY(0), Moved(false), Dark(true)
+{
+}
+
+GerberWriter::~GerberWriter()
+{
+	Close();
+}
+
+bool
+GerberWriter::Open(const string &File, const string &Layer, b_coord Height)
+{
+	Close();
+	Out = fopen(File.c_str(), "wb");
+	Failed = !Out;
+	Used = 0;
+	this->Height = Height;
+	Moved = false;
+	Dark = true;
+	if (!Out)  {
+		return false;
+	}
+
+	Put("G04 Stippled layer ");
+	// Gerber comments may not hold an asterisk.
+	string Name = Layer;
+	replace(Name.begin(), Name.end(), '*', '_');
+	Put(Name.c_str());
+	Put("*\n"
+		"%TF.GenerationSoftware,gEDA,Stipple,1*%\n"
+		"%TF.FileFunction,Other,Stipple*%\n"
+		"%TF.FilePolarity,Positive*%\n"
+		"%TF.Part,Single*%\n"
+		"%FSLAX46Y46*%\n"
+		"%MOMM*%\n"
+		"%LPD*%\n"
+		"G01*\n");
+	return true;
+}
+
+void
+GerberWriter::Clear(const b_polygon_set &Clearances)
+{
+	this->Clearances = Clearances;
+	ClearanceExtents.resize(Clearances.size());
+	for (size_t c = 0; c < Clearances.size(); c++)  {
+		boost::polygon::extents(ClearanceExtents[c], Clearances[c]);
+	}
+}
+
+void
+GerberWriter::Add(const StippledPolygon &Stippled)
+{
+	if (!Out)  {
+		return;
+	}
+
+	Polarity(true);
+	Region(Stippled.Outline.begin(), Stippled.Outline.end());
+	if (Stippled.CutOuts.Size())  {
+		Polarity(false);
+		for (size_t r = 0; r < Stippled.CutOuts.Size(); r++)  {
+			Region(Stippled.CutOuts.Begin(r), Stippled.CutOuts.End(r));
+		}
+	}
+	if (!Stippled.Overlays.empty())  {
+		Polarity(true);
+		foreach(const b_polygon &Overlay, Stippled.Overlays)  {
+			Region(Overlay.begin(), Overlay.end());
+		}
+	}
+
+	gtl::rectangle_data<b_coord> Extents;
+	boost::polygon::extents(Extents, Stippled.Outline);
+	for (size_t c = 0; c < Clearances.size(); c++)  {
+		if (gtl::intersects(Extents, ClearanceExtents[c]))  {
+			Polarity(false);
+			Region(Clearances[c].begin(), Clearances[c].end());
+		}
+	}
+}
+
+bool
+GerberWriter::Close()
+{
+	if (!Out)  {
+		return !Failed;
+	}
+
+	Put("M02*\n");
+	Flush();
+	if (fclose(Out))  {
+		Failed = true;
+	}
+	Out = NULL;
+	return !Failed;
+}
+
+template <class Iterator>
+void
+GerberWriter::Region(Iterator First, Iterator Last)
+{
+	if (First == Last)  {
+		return;
+	}
+
+	Put("G36*\n");
+	Point(gtl::x(*First), gtl::y(*First), false);
+	for (Iterator iPoint = First; ++iPoint != Last; )  {
+		Point(gtl::x(*iPoint), gtl::y(*iPoint), true);
+	}
+	// A region must end where it began, which boost's rings mostly do.
+	Point(gtl::x(*First), gtl::y(*First), true);
+	Put("G37*\n");
+}
+
+void
+GerberWriter::Point(b_coord X, b_coord Y, bool Draw)
+{
+	char Text[64];
+	char *End = Text;
+
+	Y = Height - Y;
+	if (Draw && X == LastX && Y == LastY)  {
+		return;
+	}
+	if (!Moved || X != LastX)  {
+		End += sprintf(End, "X%ld", (long)X);
+	}
+	if (!Moved || Y != LastY)  {
+		End += sprintf(End, "Y%ld", (long)Y);
+	}
+	strcpy(End, Draw ? "D01*\n" : "D02*\n");
+	Put(Text);
+
+	LastX = X;
+	LastY = Y;
+	Moved = true;
+}
+
+void
+GerberWriter::Polarity(bool Dark)
+{
+	if (Dark != this->Dark)  {
+		Put(Dark ? "%LPD*%\n" : "%LPC*%\n");
+		this->Dark = Dark;
+	}
+}
+
+void
+GerberWriter::Put(const char *Text)
+{
+	size_t Length = strlen(Text);
+
+	if (Used + Length > Buffer.size())  {
+		Flush();
+	}
+	memcpy(&Buffer[Used], Text, Length);
+	Used += Length;
+}
+
+void
+GerberWriter::Flush()
+{
+	if (Used && fwrite(&Buffer[0], 1, Used, Out) != Used)  {
+		Failed = true;
+	}
+	Used = 0;
+}
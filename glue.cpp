@@ -27,6 +27,12 @@
 
 #include "stipple.hpp"
 
+GThreadPool *TilePool;
+int TileThreads;
+bool InsertOnMainLoop;
+string BackendName;
+const BooleanBackend *Booleans;
+
 extern "C" {
 	static int
 	Stipple (int argc, char **argv, Coord x, Coord y)
@@ -34,12 +40,22 @@ extern "C" {
 		Log("\nStipple Plugin Begins\n");
 
 		StippleDialog Stippler;
+		if (argc > 0)  {
+			return Stippler.Batch(argc, argv);
+		}
 		Stippler.ParameterDialog();
 		return 0;
 	}
 
 	static HID_Action stipple_action_list[] = {
-	  { (char *)"sp", "???", Stipple, NULL, NULL}
+	  { (char *)"sp", NULL, Stipple,
+		"Stipple the perimeter layers, from the dialog or the arguments",
+		"sp()\nsp(Top|Bottom|Both|Selected|Delete|Undo|Redo"
+		"[, CompTrace, CompPitch, SolderTrace, SolderPitch][, Threads=n]"
+		"[, Report=file][, Trace=file][, Gerber=file]"
+		"[, Backend=polygon|geometry]"
+		"[, Tolerance=n][, Holes=n][, Pattern=diamond|square|hex]"
+		"[, Angle=degrees])"}
 	};
 
 	REGISTER_ACTIONS (stipple_action_list)
@@ -69,24 +85,75 @@ void LayerFactory(int i)
 	L.MakeLayer(i);
 }
 
+void TaskFactory(gpointer Task, gpointer Unused)
+{
+	((PoolTask *)Task)->Run();
+}
+
 void MakeAllLayers()
 {
-	time_t StartTime, EndTime, ElapsedTime;
+	gint64 StartTime = g_get_monotonic_time();
+	double ElapsedTime;
 
 	gpointer *LayerThreads;
 
-	time(&StartTime);
-
-	StippleDialog::Progress(0.05, "Polygon Stipple Begins...");
-	if (Cancel)  {
+	if (Cancel.IsRaised())  {
+		StippleProgress.Finish();
 		return;
 	}
 
 	if (NULL == PCB)  {
 		Log("Error: No PCB Interface!\n");
+		StippleProgress.Finish();
 		return;
 	}
 
+	// Only a run with a trace file is traced.
+	StippleTrace SharedTrace;
+	RunTrace = TraceFile.empty() ? NULL : &SharedTrace;
+	if (RunTrace)  {
+		RunTrace->NameThread("spool");
+	}
+
+	Booleans = FindBackend(BackendName);
+	if (!Booleans)  {
+		Log("Unknown geometry backend \"%.32s\", using %s\n",
+				BackendName.c_str(), DefaultBackend().Name());
+		Booleans = &DefaultBackend();
+	}
+
+	// Every circle and rounded corner of the run is cut to one tolerance.
+	ArcTessellation SharedArcs(ArcTolerance);
+	Arcs = &SharedArcs;
+
+	TilePool = g_thread_pool_new(TaskFactory, NULL,
+			TileThreads > 0 ? TileThreads : g_get_num_processors(), FALSE, NULL);
+
+	// Vias and pins are shared by both layers, so find them just once,
+	// allowing for the wider of the two traces.
+	ThroughHoleSet SharedThroughHoles;
+	if (MakeDelete != MakeLayers)  {
+		TraceSpan Loading("load through holes");
+		SharedThroughHoles.Load(max(ComponentTrace, SolderTrace));
+	}
+	ThroughHoles = &SharedThroughHoles;
+
+	StippleCache SharedCache;
+	ResultCache = &SharedCache;
+
+	// Only the main loop, or one layer thread at a time, changes the board.
+	InsertQueue SharedInserts(InsertOnMainLoop);
+	Inserts = &SharedInserts;
+	Journal.Begin();
+
+	StippleReport SharedReport;
+	SharedReport.Threads = g_thread_pool_get_max_threads(TilePool);
+	SharedReport.Backend = Booleans->Name();
+	SharedReport.Tolerance = ArcTolerance;
+	SharedReport.SplitHoles = SplitHoles;
+	SharedReport.Pattern = Pattern;
+	RunReport = &SharedReport;
+
 	LayerThreads = (gpointer *)
 				malloc(MakeLayerNames.size() * sizeof(gpointer));
 
@@ -98,18 +165,67 @@ void MakeAllLayers()
 						(GThreadFunc)LayerFactory, (gpointer)i);
 	}
 
+	TraceSpan Waiting("wait for layers");
 	for (unsigned long i = 0; i < MakeLayerNames.size(); i++)  {
 		g_thread_join((GThread *)LayerThreads[i]);
 	}
 	free(LayerThreads);
+	g_thread_pool_free(TilePool, FALSE, TRUE);
+	ThroughHoles = NULL;
+	Arcs = NULL;
+	Waiting.End();
+
+	// The layers' reports are filed by their last tasks.
+	TraceSpan Inserting("wait for inserts");
+	SharedInserts.Wait();
+	Inserts = NULL;
+
+	// Without a main loop the run was made from the board's own thread,
+	// which can draw what it inserted.
+	if (!InsertOnMainLoop)  {
+		Draw();
+	}
+	Journal.Commit();
+	Inserting.End();
+
+	if (MakeDelete != MakeLayers)  {
+		Log("Stipple Cache: %d hits, %d misses\n",
+				SharedCache.Hits, SharedCache.Misses);
+		TraceSpan Trimming("trim cache");
+		SharedCache.Trim();
+		Trimming.End();
+
+		string File = ReportFile.empty() ?
+				string(g_get_home_dir()) + stipple_report : ReportFile;
+		SharedReport.Canceled = Cancel.IsRaised();
+		SharedReport.Hits = SharedCache.Hits;
+		SharedReport.Misses = SharedCache.Misses;
+		if (SharedReport.Write(File))  {
+			Log("Stipple Report: %.96s\n", File.c_str());
+		} else  {
+			Log("Could not write the stipple report to %.80s\n", File.c_str());
+		}
+	}
+	ResultCache = NULL;
+	RunReport = NULL;
+
+	// Every thread which recorded into the trace has been joined.
+	if (RunTrace)  {
+		if (SharedTrace.Write(TraceFile))  {
+			Log("Stipple Trace: %.96s\n", TraceFile.c_str());
+		} else  {
+			Log("Could not write the stipple trace to %.80s\n",
+					TraceFile.c_str());
+		}
+		RunTrace = NULL;
+	}
 
-	time(&EndTime);
-	ElapsedTime = (long)difftime(EndTime, StartTime);
-	Log("Stipple Plugin Ends: Elapsed Time is %02d:%02d:%02d\n",
-		(ElapsedTime % (60 * 60 * 60)) / (60 * 60),
-		(ElapsedTime % (60 * 60)) / 60,
-		 ElapsedTime % 60);
+	ElapsedTime = (g_get_monotonic_time() - StartTime) * 1e-6;
+	Log("Stipple Plugin Ends: Elapsed Time is %02d:%02d:%06.3f\n",
+		(int)ElapsedTime / (60 * 60),
+		((int)ElapsedTime % (60 * 60)) / 60,
+		fmod(ElapsedTime, 60));
 
 	PCB->Changed = TRUE;
-	StippleDialog::Progress(2.0, "Polygon Stipple Ends");
+	StippleProgress.Finish();
 }
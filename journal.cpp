@@ -0,0 +1,407 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+/**
+ * \file journal.cpp
+ * \brief The undo journal of stipple runs.
+ *
+ * Numbers are packed seven bits to the byte, low bits first, with the high
+ * bit set on every byte but the last.  Signed numbers are zigzagged first,
+ * so small steps either way take a byte.  A packed polygon is its flags,
+ * point count and hole count, each hole's offset from the one before, and
+ * each point's step from the one before.  IDs are packed as steps too, and
+ * those of a run's new polygons are mostly one apart.
+ */
+
+#include "stipple.hpp"
+
+StippleJournal Journal;
+
+/// The most runs which may be undone.
+static const size_t JournalRuns = 8;
+
+/// The most bytes the runs which may be undone or redone hold.
+static const size_t JournalBytes = 64 << 20;
+
+static void
+PutNumber(string &Packed, unsigned long long Number)
+{
+	while (Number >= 0x80)  {
+		Packed += (char)(0x80 | (Number & 0x7f));
+		Number >>= 7;
+	}
+	Packed += (char)Number;
+}
+
+static unsigned long long
+GetNumber(const string &Packed, size_t &At)
+{
+	unsigned long long Number = 0;
+	int Shift = 0;
+
+	while (At < Packed.size())  {
+		unsigned char Byte = Packed[At++];
+		Number |= (unsigned long long)(Byte & 0x7f) << Shift;
+		if (!(Byte & 0x80))  {
+			break;
+		}
+		Shift += 7;
+	}
+	return Number;
+}
+
+static void
+PutSigned(string &Packed, long long Number)
+{
+	PutNumber(Packed, ((unsigned long long)Number << 1) ^ (Number >> 63));
+}
+
+static long long
+GetSigned(const string &Packed, size_t &At)
+{
+	unsigned long long Number = GetNumber(Packed, At);
+	return (long long)(Number >> 1) ^ -(long long)(Number & 1);
+}
+
+vector< pair<string, string> >
+StippleAttributes(LayerTypePtr layer)
+{
+	vector< pair<string, string> > Attributes;
+
+	for (int n = 0; n < layer->Attributes.Number; n++)  {
+		string Name = layer->Attributes.List[n].name;
+		if (!Name.compare(0, stipple_attribute.size(), stipple_attribute))  {
+			Attributes.push_back(make_pair(Name,
+					string(layer->Attributes.List[n].value)));
+		}
+	}
+	return Attributes;
+}
+
+/// The copper layer of the given name, or NULL.
+static LayerTypePtr
+FindLayer(const string &Name)
+{
+	LAYER_LOOP (PCB->Data, max_copper_layer);
+	{
+		if (!Name.compare(layer->Name))  {
+			return layer;
+		}
+	}
+	END_LOOP;
+	return NULL;
+}
+
+void
+LayerDelta::Pack(PolygonTypePtr Polygon)
+{
+	Coord X = 0, Y = 0;
+	Cardinal Hole = 0;
+
+	PutNumber(Off, Polygon->Flags.f);
+	PutNumber(Off, Polygon->PointN);
+	PutNumber(Off, Polygon->HoleIndexN);
+	for (Cardinal h = 0; h < Polygon->HoleIndexN; h++)  {
+		PutNumber(Off, Polygon->HoleIndex[h] - Hole);
+		Hole = Polygon->HoleIndex[h];
+	}
+	for (Cardinal n = 0; n < Polygon->PointN; n++)  {
+		PutSigned(Off, Polygon->Points[n].X - X);
+		PutSigned(Off, Polygon->Points[n].Y - Y);
+		X = Polygon->Points[n].X;
+		Y = Polygon->Points[n].Y;
+	}
+}
+
+void
+LayerDelta::Record(const std::set<PolygonTypePtr> &Polygons)
+{
+	vector<long int> IDs;
+	long int ID = 0;
+
+	foreach(PolygonTypePtr Polygon, Polygons)  {
+		IDs.push_back(Polygon->ID);
+	}
+	sort(IDs.begin(), IDs.end());
+	On.clear();
+	foreach(long int Next, IDs)  {
+		PutSigned(On, Next - ID);
+		ID = Next;
+	}
+}
+
+bool
+LayerDelta::Present() const
+{
+	LayerTypePtr layer = FindLayer(Layer);
+	if (!layer)  {
+		return false;
+	}
+
+	std::set<long int> IDs;
+	POLYGON_LP(layer);
+	{
+		IDs.insert(polygon->ID);
+	}
+	END_LOOP;
+
+	size_t At = 0;
+	long int ID = 0;
+	while (At < On.size())  {
+		ID += GetSigned(On, At);
+		if (!IDs.count(ID))  {
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+LayerDelta::Swap()
+{
+	LayerTypePtr layer = FindLayer(Layer);
+	if (!layer)  {
+		return;
+	}
+
+	// Take the side on the board off, packing it as it goes.
+	std::set<long int> IDs;
+	size_t At = 0;
+	long int ID = 0;
+	while (At < On.size())  {
+		ID += GetSigned(On, At);
+		IDs.insert(ID);
+	}
+
+	string Packed;
+	Packed.swap(Off);
+	POLYGON_LP(layer);
+	{
+		if (!IDs.count(polygon->ID))  {
+			continue;
+		}
+		Pack(polygon);
+		ErasePolygon(polygon);
+		DestroyObject (PCB->Data, POLYGON_TYPE, layer, polygon, polygon);
+	}
+	END_LOOP;
+
+	// And put the other side back on.
+	PolygonBatch Polygons;
+	At = 0;
+	while (At < Packed.size())  {
+		FlagType Flags = MakeFlags(GetNumber(Packed, At));
+		Cardinal PointN = GetNumber(Packed, At);
+		Cardinal HoleN = GetNumber(Packed, At);
+		PolygonTypePtr Polygon = Polygons.Add(Flags, PointN, HoleN);
+		Coord X = 0, Y = 0;
+		Cardinal Hole = 0;
+
+		for (Cardinal h = 0; h < HoleN; h++)  {
+			Hole += GetNumber(Packed, At);
+			Polygon->HoleIndex[h] = Hole;
+		}
+		for (Cardinal n = 0; n < PointN; n++)  {
+			X += GetSigned(Packed, At);
+			Y += GetSigned(Packed, At);
+			Polygon->Points[n].X = X;
+			Polygon->Points[n].Y = Y;
+		}
+		SetPolygonBoundingBox (Polygon);
+	}
+
+	std::set<PolygonTypePtr> Linked;
+	Polygons.Link(layer, Linked);
+	Record(Linked);
+
+	// The attributes go with the polygons they describe.
+	vector< pair<string, string> > Present = StippleAttributes(layer);
+	for (size_t n = 0; n < Present.size(); n++)  {
+		AttributeRemoveFromList(&layer->Attributes,
+				(char *)Present[n].first.c_str());
+	}
+	for (size_t n = 0; n < Attributes.size(); n++)  {
+		AttributePutToList(&layer->Attributes, Attributes[n].first.c_str(),
+				Attributes[n].second.c_str(), 1);
+	}
+	Attributes.swap(Present);
+}
+
+size_t
+LayerDelta::Size() const
+{
+	size_t Bytes = Layer.size() + Off.size() + On.size();
+
+	for (size_t n = 0; n < Attributes.size(); n++)  {
+		Bytes += Attributes[n].first.size() + Attributes[n].second.size();
+	}
+	return Bytes;
+}
+
+StippleJournal::StippleJournal()
+	: Board(NULL)
+{
+	g_mutex_init (&Mutex);
+}
+
+StippleJournal::~StippleJournal()
+{
+	g_mutex_clear (&Mutex);
+}
+
+size_t
+StippleJournal::Size(const Run &Deltas)
+{
+	size_t Bytes = 0;
+
+	foreach(const LayerDelta &Delta, Deltas)  {
+		Bytes += Delta.Size();
+	}
+	return Bytes;
+}
+
+bool
+StippleJournal::SameBoard() const
+{
+	return PCB == Board &&
+			!BoardFile.compare(PCB->Filename ? PCB->Filename : "");
+}
+
+void
+StippleJournal::Clear()
+{
+	Done.clear();
+	Undone.clear();
+}
+
+void
+StippleJournal::Begin()
+{
+	Current.clear();
+	g_mutex_lock (&Mutex);
+	if (!SameBoard())  {
+		Clear();
+		Board = PCB;
+		BoardFile = PCB->Filename ? PCB->Filename : "";
+	}
+	Undone.clear();
+	g_mutex_unlock (&Mutex);
+}
+
+void
+StippleJournal::Add(LayerDelta &Delta)
+{
+	Current.push_back(LayerDelta());
+	Current.back().Layer.swap(Delta.Layer);
+	Current.back().Off.swap(Delta.Off);
+	Current.back().On.swap(Delta.On);
+	Current.back().Attributes.swap(Delta.Attributes);
+}
+
+void
+StippleJournal::Commit()
+{
+	size_t Bytes = 0;
+
+	foreach(const LayerDelta &Delta, Current)  {
+		if (!Delta.Off.empty() || !Delta.On.empty())  {
+			Bytes += Delta.Size();
+		}
+	}
+	if (!Bytes)  {
+		Current.clear();
+		return;
+	}
+
+	if (Bytes > JournalBytes)  {
+		Current.clear();
+		Log("Stipple Journal: %lu bytes is too big to undo\n",
+				(unsigned long)Bytes);
+		return;
+	}
+
+	g_mutex_lock (&Mutex);
+	Done.push_back(Run());
+	Done.back().swap(Current);
+
+	// Drop the oldest runs until the rest fit.
+	size_t Held = 0;
+	foreach(const Run &Deltas, Done)  {
+		Held += Size(Deltas);
+	}
+	while (Done.size() > JournalRuns || Held > JournalBytes)  {
+		Held -= Size(Done.front());
+		Done.erase(Done.begin());
+	}
+	g_mutex_unlock (&Mutex);
+	Log("Stipple Journal: %lu bytes, undone with sp(Undo), not PCB's Undo\n",
+			(unsigned long)Bytes);
+}
+
+bool
+StippleJournal::Step(vector<Run> &From, vector<Run> &To)
+{
+	g_mutex_lock (&Mutex);
+	if (!From.empty() && !SameBoard())  {
+		Log("Stipple Journal: another board is loaded, so its runs "
+				"are forgotten\n");
+		Clear();
+	}
+	if (!From.empty())  {
+		foreach(const LayerDelta &Delta, From.back())  {
+			if (!Delta.Present())  {
+				Log("Stipple Journal: layer %.32s was edited since, so its "
+						"runs are forgotten\n", Delta.Layer.c_str());
+				Clear();
+				break;
+			}
+		}
+	}
+	if (From.empty())  {
+		g_mutex_unlock (&Mutex);
+		return false;
+	}
+	To.push_back(Run());
+	To.back().swap(From.back());
+	From.pop_back();
+
+	foreach(LayerDelta &Delta, To.back())  {
+		Delta.Swap();
+	}
+	g_mutex_unlock (&Mutex);
+
+	PCB->Changed = TRUE;
+	Redraw();
+	return true;
+}
+
+bool
+StippleJournal::Undo()
+{
+	return Step(Done, Undone);
+}
+
+bool
+StippleJournal::Redo()
+{
+	return Step(Undone, Done);
+}
@@ -0,0 +1,243 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+
+/**
+ * \file report.cpp
+ * \brief The run report: where the time went, layer by layer and union by
+ * union.
+ *
+ * The report is a single JSON object.  Times are in seconds, wall and CPU
+ * for each phase; the CPU times of tiles are those of the workers which ran
+ * them.  Memory is the process's peak resident set, in kilobytes.
+ */
+
+#include "stipple.hpp"
+
+#ifndef G_OS_WIN32
+#include <sys/resource.h>
+#endif
+
+StippleReport *RunReport;
+string ReportFile;
+
+void
+ProcessUsage(double &Cpu, long &PeakMemory)
+{
+	Cpu = 0;
+	PeakMemory = 0;
+
+#ifndef G_OS_WIN32
+	struct rusage Usage;
+	if (!getrusage(RUSAGE_SELF, &Usage))  {
+		Cpu = Usage.ru_utime.tv_sec + Usage.ru_utime.tv_usec * 1e-6 +
+				Usage.ru_stime.tv_sec + Usage.ru_stime.tv_usec * 1e-6;
+#ifdef __APPLE__
+		// In bytes here, rather than kilobytes.
+		PeakMemory = Usage.ru_maxrss / 1024;
+#else
+		PeakMemory = Usage.ru_maxrss;
+#endif
+	}
+#endif
+}
+
+string
+JsonQuote(const string &Text)
+{
+	string Quoted = "\"";
+
+	foreach(char c, Text)  {
+		if ('"' == c || '\\' == c)  {
+			Quoted += '\\';
+			Quoted += c;
+		} else if ((unsigned char)c < 0x20)  {
+			Quoted += str(boost::format("\\u%04x") % (int)c);
+		} else  {
+			Quoted += c;
+		}
+	}
+	return Quoted + "\"";
+}
+
+/// A time as a JSON number, to the microsecond.
+static string
+Seconds(double Time)
+{
+	return str(boost::format("%.6f") % Time);
+}
+
+/// The wall and CPU times of the phases from First through Last.
+static void
+WritePhases(ostream &Out, const PhaseTimes &Times,
+		StipplePhase First, StipplePhase Last, const string &Indent)
+{
+	Out << "{";
+	for (int p = First; p <= Last; p++)  {
+		Out << (p == First ? "\n" : ",\n") << Indent << "\t"
+			<< JsonQuote(PhaseNames[p]) << ": { \"wall\": "
+			<< Seconds(Times.Wall[p]) << ", \"cpu\": "
+			<< Seconds(Times.Cpu[p]) << " }";
+	}
+	Out << "\n" << Indent << "}";
+}
+
+static void
+WriteUnion(ostream &Out, const UnionReport &Union)
+{
+	const string Indent = "\t\t\t\t";
+
+	Out << "{\n"
+		<< Indent << "\"hash\": " << JsonQuote(Union.Hash) << ",\n"
+		<< Indent << "\"source\": " << JsonQuote(Union.Source) << ",\n"
+		<< Indent << "\"outline_vertices\": " << Union.OutlineVertices << ",\n"
+		<< Indent << "\"outline_holes\": " << Union.OutlineHoles << ",\n"
+		<< Indent << "\"keepouts\": " << Union.Keepouts << ",\n"
+		<< Indent << "\"tiles\": " << Union.Tiles << ",\n"
+		<< Indent << "\"cutouts\": " << Union.CutOuts << ",\n"
+		<< Indent << "\"overlays\": " << Union.Overlays << ",\n"
+		<< Indent << "\"vertices\": " << Union.Vertices << ",\n"
+		<< Indent << "\"wall\": " << Seconds(Union.Wall) << ",\n"
+		<< Indent << "\"phases\": ";
+	WritePhases(Out, Union.Times, LatticePhase, StitchPhase, Indent);
+	Out << "\n\t\t\t}";
+}
+
+static void
+WriteLayer(ostream &Out, const LayerReport &Layer)
+{
+	const string Indent = "\t\t";
+
+	Out << "{\n"
+		<< Indent << "\"template\": " << JsonQuote(Layer.Template) << ",\n"
+		<< Indent << "\"stipple\": " << JsonQuote(Layer.Stipple) << ",\n"
+		<< Indent << "\"trace_nm\": " << Layer.Trace << ",\n"
+		<< Indent << "\"pitch_nm\": " << Layer.Pitch << ",\n"
+		<< Indent << "\"templates\": " << Layer.Templates << ",\n"
+		<< Indent << "\"keepouts\": " << Layer.Keepouts << ",\n"
+		<< Indent << "\"merged_keepouts\": " << Layer.MergedKeepouts << ",\n"
+		<< Indent << "\"wall\": " << Seconds(Layer.Wall) << ",\n"
+		<< Indent << "\"peak_rss_kb\": " << Layer.PeakMemory << ",\n"
+		<< Indent << "\"phases\": ";
+	WritePhases(Out, Layer.Times, ReadPhase, InsertPhase, Indent);
+	Out << ",\n" << Indent << "\"unions\": [";
+	for (size_t u = 0; u < Layer.Unions.size(); u++)  {
+		Out << (u ? ", " : "");
+		WriteUnion(Out, Layer.Unions[u]);
+	}
+	Out << "]\n\t}";
+}
+
+UnionReport::UnionReport()
+	: OutlineVertices(0), OutlineHoles(0), Keepouts(0), Tiles(0),
+	  CutOuts(0), Overlays(0), Vertices(0), Wall(0)
+{
+}
+
+void
+UnionReport::Finish(const char *Source, const StippledPolygon &Stippled,
+		gint64 Start)
+{
+	this->Source = Source;
+	Times = Stippled.Times;
+	CutOuts = Stippled.CutOuts.Size();
+	Overlays = Stippled.Overlays.size();
+
+	Vertices = Stippled.Outline.size() + Stippled.CutOuts.Points();
+	foreach(const b_polygon &Overlay, Stippled.Overlays)  {
+		Vertices += Overlay.size();
+	}
+
+	Wall = (g_get_monotonic_time() - Start) * 1e-6;
+}
+
+LayerReport::LayerReport()
+	: Trace(0), Pitch(0), Templates(0), Keepouts(0),
+	  MergedKeepouts(0), Wall(0), PeakMemory(0)
+{
+}
+
+void
+LayerReport::Add(const UnionReport &Union)
+{
+	Unions.push_back(Union);
+	Times.Add(Union.Times);
+}
+
+StippleReport::StippleReport()
+	: Start(g_get_monotonic_time()), Threads(0), Tolerance(0), SplitHoles(0),
+	  Canceled(false), Hits(0), Misses(0)
+{
+	long PeakMemory;
+	ProcessUsage(StartCpu, PeakMemory);
+	g_mutex_init (&Mutex);
+}
+
+StippleReport::~StippleReport()
+{
+	g_mutex_clear (&Mutex);
+}
+
+void
+StippleReport::Add(const LayerReport &Layer)
+{
+	g_mutex_lock (&Mutex);
+	Layers.push_back(Layer);
+	g_mutex_unlock (&Mutex);
+}
+
+bool
+StippleReport::Write(const string &File)
+{
+	double Cpu;
+	long PeakMemory;
+	std::ostringstream Out;
+
+	ProcessUsage(Cpu, PeakMemory);
+
+	Out << "{\n"
+		<< "\t\"version\": 1,\n"
+		<< "\t\"canceled\": " << (Canceled ? "true" : "false") << ",\n"
+		<< "\t\"threads\": " << Threads << ",\n"
+		<< "\t\"backend\": " << JsonQuote(Backend) << ",\n"
+		<< "\t\"tolerance_nm\": " << Tolerance << ",\n"
+		<< "\t\"split_holes\": " << SplitHoles << ",\n"
+		<< "\t\"pattern\": "
+		<< JsonQuote(StipplePattern::Name(Pattern.Cell)) << ",\n"
+		<< "\t\"angle\": " << Pattern.Angle << ",\n"
+		<< "\t\"wall\": "
+		<< Seconds((g_get_monotonic_time() - Start) * 1e-6) << ",\n"
+		<< "\t\"cpu\": " << Seconds(Cpu - StartCpu) << ",\n"
+		<< "\t\"peak_rss_kb\": " << PeakMemory << ",\n"
+		<< "\t\"cache_hits\": " << Hits << ",\n"
+		<< "\t\"cache_misses\": " << Misses << ",\n"
+		<< "\t\"layers\": [";
+	for (size_t l = 0; l < Layers.size(); l++)  {
+		Out << (l ? ", " : "");
+		WriteLayer(Out, Layers[l]);
+	}
+	Out << "]\n}\n";
+
+	string Contents = Out.str();
+	return g_file_set_contents(File.c_str(),
+			Contents.c_str(), Contents.size(), NULL);
+}
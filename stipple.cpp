@@ -27,18 +27,17 @@
 
 #include "stipple.hpp"
 #include <time.h>
+#include <glib/gstdio.h>
 
 Coord ComponentTrace, SolderTrace, ComponentPitch, SolderPitch;
+Coord ArcTolerance;
+int SplitHoles;
+StipplePattern Pattern;
+const ArcTessellation *Arcs;
 MakeLayers_t MakeLayers;
 vector<string> MakeLayerNames;
-
-double
-Layer::Angle2D(
-		int X0, int Y0,
-		int X1, int Y1)
-{
-	return atan2((double)(X1 - X0),  (double)(Y1 - Y0));
-}
+ThroughHoleSet *ThroughHoles;
+InsertQueue *Inserts;
 
 LayerTypePtr
 Layer::FindLayerByName(string Name)  {
@@ -55,165 +54,216 @@ Layer::FindLayerByName(string Name)  {
 	return NULL;
 }
 
-b_polygon
-Layer::MakeCircularOverlay(
-		Coord x, Coord y, Coord Radius, int SegmentCount)
+b_polygon_set
+Layer::ReadTemplatePolygons(LayerTypePtr layer)
 {
-	double dTheta = PI/SegmentCount/2;
-	deque<b_point> EdgeSet;
-	b_polygon Overlay;
-
-	EdgeSet.clear();
-	for (double iTheta = -PI; iTheta <= PI; iTheta += dTheta)  {
-		EdgeSet.push_back(gtl::construct<b_point>(
-				x + Radius * cos(iTheta),
-				y + Radius * sin(iTheta)));
-	}
-	Overlay.set(EdgeSet.begin(), EdgeSet.end());
-	return Overlay;
-}
+	vector<b_polygon> PolygonSet;
 
-b_polygon
-Layer::MakeRectangularOverlay(
-		Coord x0, Coord y0, Coord x1, Coord y1, Coord Thickness)
-{
+	PolygonSet.clear();
 
-	b_polygon Overlay;
-	deque<b_point> EdgeSet;
+	POLYGON_LP(layer);
+	{
+		if (Cancel.IsRaised())  {
+			return PolygonSet;  }
 
-	double Theta = Angle2D(x0, y0, x1, y1);
-	int dx = Thickness * sin(Theta + PI/2.0);
-	int dy = Thickness * cos(Theta + PI/2.0);
+		if (MakeSelected == MakeLayers &&
+			!TEST_FLAG (SELECTEDFLAG, polygon))  {
+			continue;
+		}
 
-	EdgeSet.clear();
-	EdgeSet.push_back(gtl::construct<b_point>(x0 + dx, y0 + dy));
-	EdgeSet.push_back(gtl::construct<b_point>(x0 - dx, y0 - dy));
-	EdgeSet.push_back(gtl::construct<b_point>(x1 - dx, y1 - dy));
-	EdgeSet.push_back(gtl::construct<b_point>(x1 + dx, y1 + dy));
-	EdgeSet.push_back(gtl::construct<b_point>(x0 + dx, y0 + dy));
+		PolygonSet.push_back(
+				ReadTemplatePolygon(polygon->Points, polygon->PointN));
+	}
+	END_LOOP;
 
-	Overlay.set(EdgeSet.begin(), EdgeSet.end());
-	return Overlay;
+	return PolygonSet;
 }
 
-b_polygon
-Layer::MakeRoundedRectangle(
-		int x0, int y0, int x1, int y1, int Radius, int Smoothness)
+string
+Fingerprint(PolygonTypePtr Polygon)
 {
-	b_polygon Overlay;
-	deque<b_point> EdgeSet;
-
- 	double dTheta = PI/Smoothness/8;
+	StippleHash Hash;
 
-	// Top Edge
-	EdgeSet.push_back(gtl::construct<b_point>(x0 + Radius, y0));
-	EdgeSet.push_back(gtl::construct<b_point>(x1 - Radius, y0));
-
-	// Top Right Corner
-	for (double iTheta = PI/2; iTheta <= PI; iTheta += dTheta)  {
-			EdgeSet.push_back(gtl::construct<b_point>(
-					(x1 - Radius) - Radius * cos(iTheta),
-					(y0 + Radius) - Radius * sin(iTheta)));
+	for (Cardinal n = 0; n < Polygon->PointN; n++)  {
+		Hash.Add(Polygon->Points[n].X);
+		Hash.Add(Polygon->Points[n].Y);
 	}
-
-	// Right Edge
-	EdgeSet.push_back(gtl::construct<b_point>(x1, y0 + Radius));
-	EdgeSet.push_back(gtl::construct<b_point>(x1, y1 - Radius));
-
-	// Bottom Right Corner
-	for (double iTheta = 0; iTheta >= -PI/2; iTheta -= dTheta)  {
-			EdgeSet.push_back(gtl::construct<b_point>(
-					(x1 - Radius) + Radius * cos(iTheta),
-					(y1 - Radius) - Radius * sin(iTheta)));
+	for (Cardinal n = 0; n < Polygon->HoleIndexN; n++)  {
+		Hash.Add(Polygon->HoleIndex[n]);
 	}
+	return Hash.Hex();
+}
 
-	// Bottom Edge
-	EdgeSet.push_back(gtl::construct<b_point>(x1 - Radius, y1));
-	EdgeSet.push_back(gtl::construct<b_point>(x0 + Radius, y1));
+map<string, string>
+Layer::StippledUnions(LayerTypePtr layer)
+{
+	std::set<string> Present;
+	map<string, string> Unions;
 
-	// Bottom Left Corner
-	for (double iTheta = -PI/2; iTheta <= 0; iTheta += dTheta)  {
-		EdgeSet.push_back(gtl::construct<b_point>(
-			(x0 + Radius) - Radius * cos(iTheta),
-			(y1 - Radius) - Radius * sin(iTheta)));
+	POLYGON_LP(layer);
+	{
+		Present.insert(Fingerprint(polygon));
 	}
+	END_LOOP;
 
-	EdgeSet.push_back(gtl::construct<b_point>(x0, y1 - Radius));
-	EdgeSet.push_back(gtl::construct<b_point>(x0, y0 + Radius));
+	// A union only counts as stippled while every polygon made from it is
+	// still on the layer, untouched.
+	for (int n = 0; n < layer->Attributes.Number; n++)  {
 
-	// Top Left Corner
-	for (double iTheta = 0; iTheta <= PI/2; iTheta += dTheta)  {
-		EdgeSet.push_back(gtl::construct<b_point>(
-			(x0 + Radius) - Radius * cos(iTheta),
-			(y0 + Radius) - Radius * sin(iTheta)));
-	}
+		string Name = layer->Attributes.List[n].name;
+		string Value = layer->Attributes.List[n].value;
+		if (Name.compare(0, stipple_attribute.size(), stipple_attribute))  {
+			continue;
+		}
 
-	Overlay.set(EdgeSet.begin(), EdgeSet.end());
-	return Overlay;
+		bool Intact = true;
+		std::istringstream Fingerprints(Value);
+		string Print;
+		while (Fingerprints >> Print)  {
+			Intact = Intact && Present.count(Print);
+		}
+		if (Intact)  {
+			Unions[Name.substr(stipple_attribute.size())] = Value;
+		}
+	}
+	return Unions;
 }
 
-b_polygon_set
-Layer::ReadTemplatePolygons(LayerTypePtr layer)
+/// Record each object an r-tree search turns up.
+static int
+CollectObject(const BoxType *Box, void *Found)
 {
-	bool FirstPoint;
-	int PCnt = 0;
-	Coord x0 = 0, y0 = 0;
-	std::deque<b_point> EdgeSet;
-	vector<b_polygon> PolygonSet;
+	((std::set<const BoxType *> *)Found)->insert(Box);
+	return 1;
+}
 
-	PolygonSet.clear();
+/// Order PCB objects by their ID, which is the order they were created.
+template <class Object>
+static bool
+CompareID(const Object *A, const Object *B)
+{
+	return A->ID < B->ID;
+}
 
-	POLYGON_LP(layer);
-	{
-		if (Cancel)  {
-			return PolygonSet;  }
+/// Search one of PCB's r-trees with each of the regions, and return every
+/// object found, just once, in the order it was created.
+template <class Object>
+static vector<Object *>
+SearchTree(rtree_t *Tree, const vector<BoxType> &Regions)
+{
+	std::set<const BoxType *> Found;
+	vector<Object *> Objects;
 
-		if (MakeSelected == MakeLayers &&
-			!TEST_FLAG (SELECTEDFLAG, polygon))  {
-			continue;
+	if (NULL != Tree)  {
+		foreach(const BoxType &Region, Regions)  {
+			r_search (Tree, &Region, NULL, CollectObject, &Found);
 		}
+	}
 
-		EdgeSet.clear();
-		FirstPoint = true;
+	for (std::set<const BoxType *>::iterator iFound = Found.begin();
+			iFound != Found.end(); ++iFound)  {
+		Objects.push_back((Object *)*iFound);
+	}
+	sort(Objects.begin(), Objects.end(), CompareID<Object>);
+	return Objects;
+}
 
-		POLYGONPOINT_LP(polygon);
+void
+ThroughHoleSet::Load(Coord Trace)
+{
+	vector<BoxType> Regions;
+
+	// The unions are not known yet, but they lie within the template
+	// polygons, whose bounding boxes PCB keeps up to date.
+	foreach(const string &Name, MakeLayerNames)  {
+		LAYER_LOOP (PCB->Data, max_copper_layer);
 		{
-			if (FirstPoint)  {
-				x0 = point->X; y0 = point->Y;
-				FirstPoint = false;
+			if (Name.compare(layer->Name))  {
+				continue;
 			}
 
-			// Insert to the head of the list to achieve
-			// counterclockwise winding
-			EdgeSet.push_back(gtl::construct
-					<b_point>(point->X, point->Y));
+			POLYGON_LP(layer);
+			{
+				if (MakeSelected == MakeLayers &&
+					!TEST_FLAG (SELECTEDFLAG, polygon))  {
+					continue;
+				}
+
+				BoxType Region = polygon->BoundingBox;
+				Region.X1 -= Trace + 1;
+				Region.Y1 -= Trace + 1;
+				Region.X2 += Trace + 1;
+				Region.Y2 += Trace + 1;
+				Regions.push_back(Region);
+			}
+			END_LOOP;
 		}
 		END_LOOP;
+	}
 
-		// Close the Polygon Set for correct Boost operation
-		EdgeSet.push_back(gtl::construct<b_point>(x0, y0));
+	Vias.clear();
+	foreach(PinType *via, SearchTree<PinType>(PCB->Data->via_tree, Regions))  {
+		ThroughHole Hole;
+		Hole.X = via->X;
+		Hole.Y = via->Y;
+		Hole.Thickness = via->Thickness;
+		Hole.Clearance = via->Clearance;
+		Hole.ElementID = via->ID;
+		Vias.push_back(Hole);
+	}
 
-		b_polygon Polygon;
-		Polygon.set(EdgeSet.begin(), EdgeSet.end());
-		PolygonSet.push_back(Polygon);
-		++PCnt;
+	Pins.clear();
+	foreach(PinType *pin, SearchTree<PinType>(PCB->Data->pin_tree, Regions))  {
+		ThroughHole Hole;
+		Hole.X = pin->X;
+		Hole.Y = pin->Y;
+		Hole.Thickness = pin->Thickness;
+		Hole.Clearance = pin->Clearance;
+		Hole.ElementID = ((ElementType *)pin->Element)->ID;
+		Pins.push_back(Hole);
 	}
-	END_LOOP;
+}
 
-	return PolygonSet;
+void
+ThroughHoleSet::Add(OverlayBatch &Batch, const ThroughHole &Hole,
+		Coord Trace) const
+{
+	Batch.AddHoleKeepout(Hole.X, Hole.Y, Hole.Thickness, Hole.Clearance,
+			Trace);
 }
 
 b_polygon_set
-Layer::LoadPCB(string LayerName, Coord Trace)
+Layer::LoadPCB(string LayerName, Coord Trace, const b_polygon_set &Union,
+		b_polygon_set *Clearances)
 {
 	LayerTypePtr layer;
 	b_polygon_set OverlayEdgeSet;
+	OverlayBatch Batch, ClearanceBatch;
+
+	// Only objects whose keepouts could reach a union matter, and PCB
+	// already indexes its objects by their bounding boxes.  Those boxes
+	// include the clearance, so only the trace must be added.
+	vector<BoxType> Regions;
+	gtl::rectangle_data<Coord> Extents;
 
-	VIA_LP(PCB->Data);  {
-		OverlayEdgeSet.push_back( MakeCircularOverlay(via->X, via->Y,
-				Trace + (via->Thickness + via->Clearance)/(Coord)2));
+	foreach(const b_polygon &Polygon, Union)  {
+		BoxType Region;
+		extents(Extents, Polygon);
+		Region.X1 = xl(Extents) - Trace - 1;
+		Region.Y1 = yl(Extents) - Trace - 1;
+		Region.X2 = xh(Extents) + Trace + 1;
+		Region.Y2 = yh(Extents) + Trace + 1;
+		Regions.push_back(Region);
+	}
+
+	// Vias and pins are the same on both sides, so they were extracted
+	// once for every layer; only this layer's trace is added here.
+	foreach(const ThroughHole &via, ThroughHoles->Vias)  {
+		ThroughHoles->Add(Batch, via, Trace);
+		if (Clearances)  {
+			ThroughHoles->Add(ClearanceBatch, via, 0);
+		}
 	}
-	END_LOOP;
 
 	if	((( MakeTopLayer 	== MakeLayers ||
 			MakeBothLayers 	== MakeLayers ||
@@ -227,260 +277,798 @@ Layer::LoadPCB(string LayerName, Coord Trace)
 			NULL != (layer = FindLayerByName("solder"))))  {
 
 		// Handle each line on the layer, as an area without holes
-		LINE_LP(layer);
+		foreach(LineType *line, SearchTree<LineType>(layer->line_tree, Regions))
 		{
-			Coord Thickness  = Trace +
-					(line->Thickness + line->Clearance)/ (Coord)2;
-
-			// Add a bloated polygon hole right over the line...
-			OverlayEdgeSet.push_back( MakeRectangularOverlay(
-					line->Point1.X, line->Point1.Y,
-					line->Point2.X, line->Point2.Y, Thickness));
-
-			// ...and add two barbells at the ends of the line
-			OverlayEdgeSet.push_back( MakeCircularOverlay(
-					line->Point1.X, line->Point1.Y, Thickness));
-
-			OverlayEdgeSet.push_back( MakeCircularOverlay(
-					line->Point2.X, line->Point2.Y, Thickness));
+			Batch.AddLineKeepout(line->Point1.X, line->Point1.Y,
+					line->Point2.X, line->Point2.Y,
+					line->Thickness, line->Clearance, Trace);
+			if (Clearances)  {
+				ClearanceBatch.AddLineKeepout(line->Point1.X, line->Point1.Y,
+						line->Point2.X, line->Point2.Y,
+						line->Thickness, line->Clearance, 0);
+			}
 		}
-		END_LOOP;
 	}
 
 	// Each Pad's Coordinates are relative to the element's mark, which
 	// is where the component was placed on the layout.
-	gtl::rectangle_data<Coord> Extents;
-	b_polygon_set Pads;
+
+	// Gather the pads and pins found under each element, so that they are
+	// handled element by element just as the element list would have it.
+	typedef pair< vector<PadType *>, vector<const ThroughHole *> >
+			ElementObjects;
+	map<long int, ElementObjects> Elements;
+
+	foreach(PadType *pad, SearchTree<PadType>(PCB->Data->pad_tree, Regions))  {
+		Elements[((ElementType *)pad->Element)->ID].first.push_back(pad);
+	}
+	foreach(const ThroughHole &pin, ThroughHoles->Pins)  {
+		Elements[pin.ElementID].second.push_back(&pin);
+	}
 
 	// No holes may be placed in Elements
-	ELEMENT_LP(PCB->Data);
+	for (map<long int, ElementObjects>::iterator iElement = Elements.begin();
+			iElement != Elements.end(); ++iElement)
 	{
-		if	((LayerName == component_stipple && FRONT(element)) ||
-			 (LayerName == solder_stipple && !FRONT(element)))  {
+		foreach(PadType *pad, iElement->second.first)
+		{
+			ElementType *element = (ElementType *)pad->Element;
 
-			// Pads for this element
-			PAD_LP(element);
-			{
-				Pads.clear();
-				Coord Clear = Trace + pad->Thickness/2 + pad->Clearance/2;
-				Pads += rectangle_data<Coord>(
-						pad->Point1.X - Clear,
-						pad->Point1.Y - Clear,
-						pad->Point2.X + Clear,
-						pad->Point2.Y + Clear);
-
-				extents(Extents, Pads);
-
-				OverlayEdgeSet.push_back(
-						MakeRoundedRectangle(
-							xl(Extents), yl(Extents), xh(Extents), yh(Extents),
-							Trace + pad->Clearance/2, 8));
+			if	((LayerName == component_stipple && !FRONT(element)) ||
+				 (LayerName == solder_stipple && FRONT(element)))  {
+				continue;
+			}
+
+			Batch.AddPadKeepout(pad->Point1.X, pad->Point1.Y,
+					pad->Point2.X, pad->Point2.Y,
+					pad->Thickness, pad->Clearance, Trace);
+			if (Clearances)  {
+				ClearanceBatch.AddPadKeepout(pad->Point1.X, pad->Point1.Y,
+						pad->Point2.X, pad->Point2.Y,
+						pad->Thickness, pad->Clearance, 0);
 			}
-			END_LOOP;
-			Pads.clear();
 		}
 
 		// Pins for this element are on both sides
-		PIN_LP(element);
+		foreach(const ThroughHole *pin, iElement->second.second)
 		{
-			OverlayEdgeSet.push_back( MakeCircularOverlay(pin->X, pin->Y,
-					Trace + (pin->Thickness + pin->Clearance)/(Coord)2));
+			ThroughHoles->Add(Batch, *pin, Trace);
+			if (Clearances)  {
+				ThroughHoles->Add(ClearanceBatch, *pin, 0);
+			}
 		}
-		END_LOOP;
 	}
-	END_LOOP;
+
+	// Only now are the keepouts made, all at once.
+	Batch.Generate(OverlayEdgeSet, *Arcs);
+	if (Clearances)  {
+		ClearanceBatch.Generate(*Clearances, *Arcs);
+	}
 	return OverlayEdgeSet;
 }
 
-vector<StippledPolygon>
-Layer::CalculateStipples(
-		LayerTypePtr layer, b_polygon_set Union,
-		Coord Trace, Coord Pitch, int i)
+PoolBatch::PoolBatch() : Pending(0)
 {
-	int PCnt;
-	vector<b_hole> H;
-	b_polygon Diamond;
-	b_polygon_set Stipple, Container, IntersectionSet, ComponentSet;
-
-	// Cypress refers to a 7 mil line with a 7 mil spacing as a 10% fill
-	Coord Dx_Line = Trace * sqrt(2);
-	Coord Dx_Hole = (Pitch - Trace) * sqrt(2);
+	g_mutex_init (&Mutex);
+	g_cond_init (&Done);
+}
 
-	gtl::rectangle_data<Coord> Extents;
+PoolBatch::~PoolBatch()
+{
+	g_cond_clear (&Done);
+	g_mutex_clear (&Mutex);
+}
 
-	StippledPolygon AddStippledPolygon;
-	vector<StippledPolygon> StippledPolygons;
+void
+PoolBatch::Push(PoolTask *Task)
+{
+	g_mutex_lock (&Mutex);
+	++Pending;
+	g_mutex_unlock (&Mutex);
+	g_thread_pool_push (TilePool, Task, NULL);
+}
 
-	ComponentSet = LoadPCB(layer->Name, Trace);
-	PCnt = 0;
+void
+PoolBatch::Finished()
+{
+	g_mutex_lock (&Mutex);
+	--Pending;
+	g_cond_signal (&Done);
+	g_mutex_unlock (&Mutex);
+}
 
-	foreach(b_polygon ThisPolygon, Union) {
+void
+PoolBatch::Wait()
+{
+	g_mutex_lock (&Mutex);
+	while (Pending > 0)  {
+		g_cond_wait (&Done, &Mutex);
+	}
+	g_mutex_unlock (&Mutex);
+}
 
-		string ProgressMessage;
-		ProgressMessage = str( boost::format(
-				"Area %d of %ld for \"%s\"...") %
-				(PCnt+1) % Union.size() % layer->Name);
+void
+TileTask::Run()
+{
+	Set->Run(*Tile);
+}
 
-		bool EveryOther = true;
-		boost::polygon::extents(Extents, ThisPolygon);
-		Container += ThisPolygon;
+void
+PooledTileSet::Calculate()
+{
+	// The tasks must all be in place before the first is pushed, since
+	// the vector may not move beneath the pool.
+	Tasks.resize(Tiles.size());
+	for (size_t t = 0; t < Tiles.size(); t++)  {
+		Tasks[t].Set = this;
+		Tasks[t].Tile = &Tiles[t];
+	}
+	for (size_t t = 0; t < Tasks.size(); t++)  {
+		Batch.Push(&Tasks[t]);
+	}
+	Batch.Wait();
+}
 
-		Coord Dx, Dy, X, Y;
+void
+PooledTileSet::Run(StippleTile &Tile)
+{
+	if (!Cancel.IsRaised())  {
+		gint64 Start = RunTrace ? g_get_monotonic_time() : 0;
+
+		Tile.Calculate();
+
+		// The tile times its phases one after the other, so they are laid
+		// end to end from its start.
+		if (RunTrace)  {
+			gint64 End = Start;
+			for (int p = LatticePhase; p <= OverlayPhase; p++)  {
+				gint64 Next = End + (gint64)(Tile.Times.Wall[p] * 1e6);
+				RunTrace->Add(PhaseNames[p], End, Next);
+				End = Next;
+			}
+			RunTrace->Add("tile", Start, g_get_monotonic_time());
+			RunTrace->NameThread("tile worker");
+		}
+	}
 
-		// Set up the bounding rectangle for the unionized set.
-		// Shrink it to expose the perimeter and to expose a margin
-		// around each cut-out used to outline the pattern.
-		Container -= (int)Trace;
-		Dx = Dx_Line + Dx_Hole;
-		Dy = Dx;
-		Y = Dy * (yl(Extents) / Dy);
+	StippleProgress.TileDone(Layer);
+	Batch.Finished();
+}
 
-		while (Y < yh(Extents) + Dy) {
+void
+MergeTask::Run()
+{
+	Reduction->Run(Merge);
+}
 
-			if (Cancel)  {
-				return StippledPolygons;
+void
+PooledUnionReduction::Calculate()
+{
+	while (Merges() > 0 && !Cancel.IsRaised())  {
+		Tasks.resize(Merges());
+		for (size_t m = 0; m < Tasks.size(); m++)  {
+			Tasks[m].Reduction = this;
+			Tasks[m].Merge = m;
+		}
+		// A lone merge, as at the root of the tree, gains nothing from
+		// the pool.
+		if (Tasks.size() == 1)  {
+			Run(0);
+		} else {
+			for (size_t m = 0; m < Tasks.size(); m++)  {
+				Batch.Push(&Tasks[m]);
 			}
+			Batch.Wait();
+		}
+		NextLevel();
+	}
+}
 
-			// No look-ahead on the progress estimate, just a fraction of
-			// the layers, polygons within the layers, and loop iteration.
-			// About all that can be said in this expression's favor is that
-			// it doesn't ever go backwards.
-			StippleDialog::Progress(0.05 + (0.95 *
-				(float)i / (float)MakeLayerNames.size() +
-				1.0 / (float)MakeLayerNames.size() *
-				(float)PCnt / (float)Union.size() +
-				1.0 / (float)MakeLayerNames.size() * 1.0 / (float)Union.size() *
-				((float)(Y - yl(Extents)) /
-				((float)yh(Extents) - (float)yl(Extents) + (float)Dy))),
-				ProgressMessage);
-
-			// ping-pong to inset the squares to form a mosaic pattern
-			X = Dx * (xl(Extents) / Dx);
-			if (EveryOther) {
-				X -= Dx / 2;
-				EveryOther = false;
-			} else {
-				EveryOther = true;
-			}
-			while (X < xh(Extents) + Dx) {
+void
+PooledUnionReduction::Run(size_t m)
+{
+	if (!Cancel.IsRaised())  {
+		TraceSpan Merging("merge");
+		Merge(m);
+		Merging.End();
+		if (RunTrace)  {
+			RunTrace->NameThread("tile worker");
+		}
+	}
+	Batch.Finished();
+}
 
-				if (Cancel)  {
-					return StippledPolygons;
-				}
+void
+Layer::CalculateStipples(
+		LayerTypePtr layer, const b_polygon_set &Union,
+		Coord Trace, Coord Pitch, int i,
+		const map<string, string> &Existing, LayerInsert &Target)
+{
+	b_polygon_set ComponentSet;
+	vector< gtl::rectangle_data<Coord> > ComponentExtents;
+	vector<b_keepout_entry> Entries;
+	vector<unsigned long long> KeepoutHashes;
+
+	gtl::rectangle_data<Coord> Extents;
+	PhaseClock Clock;
+
+	TraceSpan Loading("load keepouts");
+	b_polygon_set Clearances;
+	LoadPCB(layer->Name, Trace, Union, Export ? &Clearances : NULL)
+			.swap(ComponentSet);
+	if (Export)  {
+		Export->Clear(Clearances);
+	}
+	Report.Keepouts = ComponentSet.size();
+	Spacing = StippleLattice::Spacing(Trace, Pitch);
+
+	// The barbells of neighbouring lines overlap almost entirely, so merge
+	// the keepouts into disjoint regions before anything else is done with
+	// them.  Each region is then hashed, indexed and intersected just once.
+	PooledUnionReduction Consolidation;
+	Consolidation.Plan(ComponentSet, *Booleans);
+	Consolidation.Calculate();
+	if (Cancel.IsRaised())  {
+		return;
+	}
+	Consolidation.Result().swap(ComponentSet);
+	Report.MergedKeepouts = ComponentSet.size();
+
+	ComponentExtents.resize(ComponentSet.size());
+	for (size_t k = 0; k < ComponentSet.size(); k++)  {
+		boost::polygon::extents(ComponentExtents[k], ComponentSet[k]);
+		Entries.push_back(b_keepout_entry(b_box(
+				b_corner(xl(ComponentExtents[k]), yl(ComponentExtents[k])),
+				b_corner(xh(ComponentExtents[k]), yh(ComponentExtents[k]))), k));
+
+		// Merged regions can enclose holes, which the hash must tell apart.
+		StippleHash Hash;
+		Hash.Add(ComponentSet[k].begin(), ComponentSet[k].end());
+		for (polygon_with_holes_traits<b_polygon>::iterator_holes_type
+				iHole = begin_holes(ComponentSet[k]);
+				iHole != end_holes(ComponentSet[k]); ++iHole)  {
+			Hash.Add(iHole->begin(), iHole->end());
+		}
+		KeepoutHashes.push_back(Hash.Value);
+	}
+
+	// Bulk load the keepouts into an R-tree, so each union only ever looks
+	// at the keepouts which could touch it.
+	b_keepout_index KeepoutIndex(Entries.begin(), Entries.end());
+	Clock.Charge(Report.Times, LoadPhase);
+	Loading.End();
+	StippleProgress.Unions(i, Union.size());
+
+	foreach(const b_polygon &ThisPolygon, Union) {
+
+		// Each union is made in place, and handed to the insert queue as
+		// PCB polygons as soon as it is done.
+		PooledTileSet Set;
+		StippledPolygon AddStippledPolygon;
+		UnionReport Statistics;
+		gint64 Start = g_get_monotonic_time();
+		TraceSpan Stippling("union");
 
-				b_point DiamondPoints[] = {
-					gtl::construct<b_point>(X, Y-Dx_Hole / 2), // Top
-					gtl::construct<b_point>(X+Dx_Hole/2, Y),   // Right
-					gtl::construct<b_point>(X, Y+Dx_Hole/2),   // Bottom
-					gtl::construct<b_point>(X-Dx_Hole/2, Y) }; // Left
+		boost::polygon::extents(Extents, ThisPolygon);
 
-				gtl::set_points(Diamond, DiamondPoints, DiamondPoints + 4);
-				Stipple += Diamond;	// This is the expensive operation
-				X += Dx;
+		vector<b_keepout_entry> Candidates;
+		KeepoutIndex.query(bgi::intersects(b_box(
+				b_corner(xl(Extents), yl(Extents)),
+				b_corner(xh(Extents), yh(Extents)))),
+				back_inserter(Candidates));
+
+		// Hash everything the union depends upon.  The keepouts may come
+		// back from the index in any order, so their hashes are sorted.
+		StippleHash Hash;
+		vector<unsigned long long> CandidateHashes;
+
+		Hash.Add(ThisPolygon.begin(), ThisPolygon.end());
+		for (polygon_with_holes_traits<b_polygon>::iterator_holes_type
+				iHole = begin_holes(ThisPolygon);
+				iHole != end_holes(ThisPolygon); ++iHole)  {
+			Hash.Add(iHole->begin(), iHole->end());
+		}
+		Hash.Add(Trace);
+		Hash.Add(Pitch);
+		if (Pattern.Cell != StipplePattern::Diamond || Pattern.Turned())  {
+			Hash.Add(Pattern.Cell);
+			Hash.Add((long long)(Pattern.Angle * 1e6));
+		}
+		if (Booleans != &DefaultBackend())  {
+			foreach(char c, string(Booleans->Name()))  {
+				Hash.Add(c);
 			}
-			Y += Dy/2;
 		}
+		foreach(const b_keepout_entry &Candidate, Candidates)  {
+			CandidateHashes.push_back(KeepoutHashes[Candidate.second]);
+		}
+		sort(CandidateHashes.begin(), CandidateHashes.end());
+		foreach(unsigned long long CandidateHash, CandidateHashes)  {
+			Hash.Add(CandidateHash);
+		}
+
+		// The cache holds the union before it is split, so only the union
+		// on the board depends on the split budget.
+		string CacheKey = Hash.Hex();
+		if (SplitHoles)  {
+			Hash.Add(SplitHoles);
+		}
+		AddStippledPolygon.Hash = Hash.Hex();
+		Statistics.Hash = AddStippledPolygon.Hash;
+		Statistics.OutlineVertices = ThisPolygon.size();
+		Statistics.OutlineHoles = ThisPolygon.size_holes();
+		Statistics.Keepouts = Candidates.size();
+
+		if (!Export && Existing.count(AddStippledPolygon.Hash))  {
+			AddStippledPolygon.Unchanged = true;
+			Statistics.Finish("unchanged", StippledPolygon(), Start);
+			Report.Add(Statistics);
+			Target.Reached.push_back(ThisPolygon);
+			Insert(AddStippledPolygon, Target);
+			StippleProgress.UnionDone(i);
+			continue;
+		}
+
+		// Stippled before, perhaps on another day or another board.
+		TraceSpan Fetching("fetch from cache");
+		if (ResultCache && ResultCache->Fetch(CacheKey, AddStippledPolygon))  {
+			Statistics.Finish("cached", AddStippledPolygon, Start);
+			Report.Add(Statistics);
+			Target.Reached.push_back(ThisPolygon);
+			Insert(AddStippledPolygon, Target);
+			StippleProgress.UnionDone(i);
+			continue;
+		}
+
+		Fetching.End();
+
+		vector<size_t> Keepouts;
+		foreach(const b_keepout_entry &Candidate, Candidates)  {
+			Keepouts.push_back(Candidate.second);
+		}
+		Set.Plan(ThisPolygon, ComponentSet, Keepouts, Trace, Pitch,
+				*Booleans, Pattern);
+
+		Set.Layer = i;
+		StippleProgress.StartUnion(i, Set.Tiles.size());
+
+		// The workers count their tiles into StippleProgress themselves,
+		// so there is nothing to do here but wait.
+		TraceSpan Waiting("wait for tiles");
+		Set.Calculate();
+		Waiting.End();
 
-		// Intersect all the stipples with the container
-		IntersectionSet += Stipple & Container;
+		if (Cancel.IsRaised())  {
+			return;
+		}
 
-		AddStippledPolygon.Outline = ThisPolygon;
-		AddStippledPolygon.CutOuts = IntersectionSet;
+		TraceSpan Stitching("stitch");
+		Set.Stitch(AddStippledPolygon);
+		Stitching.End();
 
-		foreach(b_polygon ThisComponent, ComponentSet)  {
-			AddStippledPolygon.Overlays += ThisComponent * ThisPolygon;
+		if (ResultCache)  {
+			TraceSpan Storing("store in cache");
+			ResultCache->Store(CacheKey, AddStippledPolygon);
 		}
 
-		StippledPolygons.push_back(AddStippledPolygon);
+		Statistics.Tiles = Set.Tiles.size();
+		Statistics.Finish("stippled", AddStippledPolygon, Start);
+		Report.Add(Statistics);
+		Target.Reached.push_back(ThisPolygon);
+		Insert(AddStippledPolygon, Target);
+		StippleProgress.UnionDone(i);
+	}
+}
 
-		Stipple.clear();
-		Container.clear();
-		IntersectionSet.clear();
-		++PCnt;
+PolygonBatch::~PolygonBatch()
+{
+	for (GList *iPolygon = Polygons; iPolygon; iPolygon = iPolygon->next)  {
+		PolygonTypePtr Polygon = (PolygonTypePtr)iPolygon->data;
+		free(Polygon->Points);
+		free(Polygon->HoleIndex);
+		g_slice_free(PolygonType, Polygon);
 	}
-	return StippledPolygons;
+	g_list_free(Polygons);
+}
+
+PolygonTypePtr
+PolygonBatch::Add(FlagType Flags, Cardinal PointN, Cardinal HoleN)
+{
+	// Allocated just as CreateNewPolygon and its points would be, so that
+	// PCB frees them the same way.
+	PolygonTypePtr Polygon = g_slice_new0(PolygonType);
+
+	Polygon->Flags = Flags;
+	Polygon->PointN = Polygon->PointMax = PointN;
+	Polygon->Points = (PointTypePtr)malloc(PointN * sizeof(PointType));
+	if (HoleN)  {
+		Polygon->HoleIndexN = Polygon->HoleIndexMax = HoleN;
+		Polygon->HoleIndex = (Cardinal *)malloc(HoleN * sizeof(Cardinal));
+	}
+
+	Polygons = g_list_prepend(Polygons, Polygon);
+	++Count;
+	Points += PointN;
+	return Polygon;
 }
 
 void
-Layer::InsertToPCB(
-		LayerTypePtr layer, vector<StippledPolygon> StippledPolygons)
+PolygonBatch::Link(LayerTypePtr layer, std::set<PolygonTypePtr> &Linked)
 {
+	vector<const BoxType *> Boxes;
+
+	// PCB's IDs are only ever handed out on the thread which owns the
+	// board, so the block is taken here rather than while building.
+	long int ID = CreateIDGet();
+	CreateIDBump(ID + Count + Points);
+
+	Polygons = g_list_reverse(Polygons);
+	Boxes.reserve(Count);
+	for (GList *iPolygon = Polygons; iPolygon; iPolygon = iPolygon->next)  {
+		PolygonTypePtr Polygon = (PolygonTypePtr)iPolygon->data;
+		Polygon->ID = ID++;
+		for (Cardinal n = 0; n < Polygon->PointN; n++)  {
+			Polygon->Points[n].ID = ID++;
+		}
+		Boxes.push_back((const BoxType *)Polygon);
+		Linked.insert(Polygon);
+		DrawPolygon(layer, Polygon);
+	}
+
+	if (!layer->PolygonN && layer->polygon_tree)  {
+		r_destroy_tree (&layer->polygon_tree);
+	}
+	if (!layer->polygon_tree)  {
+		layer->polygon_tree = r_create_tree (
+				Boxes.empty() ? NULL : &Boxes[0], Boxes.size(), 0);
+	} else  {
+		foreach(const BoxType *Box, Boxes)  {
+			r_insert_entry (layer->polygon_tree, Box, 0);
+		}
+	}
+
+	layer->Polygon = g_list_concat(layer->Polygon, Polygons);
+	layer->PolygonN += Count;
+
+	Polygons = NULL;
+	Count = Points = 0;
+}
+
+LayerInsert::LayerInsert(LayerTypePtr layer, gint64 Start)
+	: Stipple(layer), Reused(0), Unions(0), Partial(false),
+	  Attributes(StippleAttributes(layer)), Start(Start)
+{
+}
+
+bool
+LayerInsert::Reaches(PolygonTypePtr Polygon) const
+{
+	gtl::rectangle_data<Coord> Box(Polygon->BoundingBox.X1,
+			Polygon->BoundingBox.Y1, Polygon->BoundingBox.X2,
+			Polygon->BoundingBox.Y2);
+	Cardinal OutlineN =
+			Polygon->HoleIndexN ? Polygon->HoleIndex[0] : Polygon->PointN;
+	vector<b_point> Points;
+	b_polygon Outline;
+
+	for (Cardinal n = 0; n < OutlineN; n++)  {
+		Points.push_back(b_point(Polygon->Points[n].X, Polygon->Points[n].Y));
+	}
+	gtl::set_points(Outline, Points.begin(), Points.end());
+
+	foreach(const b_polygon &Union, Reached)  {
+		gtl::rectangle_data<Coord> Extents;
+		boost::polygon::extents(Extents, Union);
+		if (gtl::intersects(Extents, Box) && !Booleans->Intersect(
+				b_polygon_set(1, Outline), b_polygon_set(1, Union)).empty())  {
+			return true;
+		}
+	}
+	return false;
+}
+
+UnionInsert::UnionInsert(LayerInsert &Target, const StippledPolygon &Union)
+	: Target(Target), Hash(Union.Hash), Unchanged(Union.Unchanged)
+{
+}
+
+void
+UnionInsert::Run()
+{
+	PhaseClock Clock;
+	TraceSpan Inserting("insert union");
+	LayerTypePtr layer = Target.Stipple;
+
+	++Target.Unions;
+	Target.Current.insert(Hash);
+
+	if (Unchanged)  {
+		std::istringstream Prints(AttributeGetFromList(&layer->Attributes,
+				(char *)(stipple_attribute + Hash).c_str()));
+		string Print;
+		while (Prints >> Print)  {
+			Target.Keep.insert(Print);
+		}
+		++Target.Reused;
+	} else  {
+		Polygons.Link(layer, Target.Made);
+
+		// Record what the union made, so the next run can leave it in
+		// place.
+		string Joined;
+		foreach(const string &Print, Fingerprints)  {
+			Joined += (Joined.empty() ? "" : " ") + Print;
+		}
+		AttributePutToList(&layer->Attributes,
+				(stipple_attribute + Hash).c_str(), Joined.c_str(), 1);
+	}
+	Clock.Charge(Target.Times, InsertPhase);
+}
+
+LayerFinish::LayerFinish(
+		LayerInsert *Target, bool Erase, const LayerReport *Report)
+	: Target(Target), Erase(Erase),
+	  Report(Report ? new LayerReport(*Report) : NULL)
+{
+}
+
+LayerFinish::~LayerFinish()
+{
+	delete Report;
+	delete Target;
+}
+
+void
+LayerFinish::Run()
+{
+	PhaseClock Clock;
+	TraceSpan Finishing("finish layer");
+	LayerTypePtr layer = Target->Stipple;
+	LayerDelta Delta;
+
+	Delta.Layer = layer->Name;
+	Delta.Attributes.swap(Target->Attributes);
+	if (Erase)  {
+		std::set<string> Erased;
 
-	if (MakeSelected != MakeLayers)  {
 		POLYGON_LP(layer);
 		{
+			if (Target->Made.count(polygon))  {
+				continue;
+			}
+
+			// A run canceled partway replaces only the unions it got to,
+			// and leaves the stipples of the rest as they were.
+			string Print = Fingerprint(polygon);
+			if (Target->Keep.count(Print) ||
+					(Target->Partial && !Target->Reaches(polygon)))  {
+				continue;
+			}
+			Erased.insert(Print);
+			Delta.Pack(polygon);
 			ErasePolygon(polygon);
-			MoveObjectToRemoveUndoList (POLYGON_TYPE, layer, polygon, polygon);
+			DestroyObject (PCB->Data, POLYGON_TYPE, layer, polygon, polygon);
 		}
 		END_LOOP;
+
+		// Forget the unions which are no longer on the layer.
+		for (int n = layer->Attributes.Number - 1; n >= 0; n--)  {
+			string Name = layer->Attributes.List[n].name;
+			if (Name.compare(0, stipple_attribute.size(), stipple_attribute)
+					|| Target->Current.count(
+							Name.substr(stipple_attribute.size())))  {
+				continue;
+			}
+
+			// Those a canceled run did not get to still have their
+			// polygons.
+			bool Replaced = !Target->Partial;
+			std::istringstream Prints(layer->Attributes.List[n].value);
+			string Print;
+			while (!Replaced && Prints >> Print)  {
+				Replaced = Erased.count(Print);
+			}
+			if (Replaced)  {
+				AttributeRemoveFromList(&layer->Attributes, (char *)Name.c_str());
+			}
+		}
+	}
+	Delta.Record(Target->Made);
+	Journal.Add(Delta);
+	Clock.Charge(Target->Times, InsertPhase);
+	Finishing.End();
+
+	if (!Report)  {
+		return;
+	}
+
+	Log("%s: %d of %d areas unchanged\n",
+			layer->Name, Target->Reused, Target->Unions);
+
+	double Cpu;
+	Report->Times.Add(Target->Times);
+	Report->Wall = (g_get_monotonic_time() - Target->Start) * 1e-6;
+	ProcessUsage(Cpu, Report->PeakMemory);
+	if (RunReport)  {
+		RunReport->Add(*Report);
+	}
+}
+
+/// The longest the main loop is kept inserting at one go, in microseconds.
+static const gint64 InsertSlice = 10000;
+
+InsertQueue::InsertQueue(bool MainLoop)
+	: Tasks(g_async_queue_new()), MainLoop(MainLoop),
+	  Pending(0), Draining(false)
+{
+	g_mutex_init (&Mutex);
+	g_cond_init (&Done);
+}
+
+InsertQueue::~InsertQueue()
+{
+	g_cond_clear (&Done);
+	g_mutex_clear (&Mutex);
+	g_async_queue_unref (Tasks);
+}
+
+void
+InsertQueue::Push(InsertTask *Task)
+{
+	if (!MainLoop)  {
+		g_mutex_lock (&Mutex);
+		Task->Run();
+		g_mutex_unlock (&Mutex);
+		delete Task;
+		return;
+	}
+
+	g_mutex_lock (&Mutex);
+	++Pending;
+	g_mutex_unlock (&Mutex);
+	g_async_queue_push (Tasks, Task);
+
+	// The handler takes itself off once it finds the queue empty, so it
+	// is put back by the first task after that.
+	g_mutex_lock (&Mutex);
+	bool Install = !Draining;
+	Draining = true;
+	g_mutex_unlock (&Mutex);
+	if (Install)  {
+		g_idle_add (Drain, this);
 	}
+}
 
-	foreach(StippledPolygon ThisPolygon, StippledPolygons) {
+gboolean
+InsertQueue::Drain(gpointer Queue)
+{
+	InsertQueue *Self = (InsertQueue *)Queue;
+	gint64 Until = g_get_monotonic_time() + InsertSlice;
+	InsertTask *Task;
+
+	if (RunTrace)  {
+		RunTrace->NameThread("main loop");
+	}
 
-		PolygonTypePtr NewPolygon =
-				// FULLPOLYFLAG would make bisection of stippled areas occur.
-				CreateNewPolygon (layer, MakeFlags(CLEARPOLYFLAG));
+	while ((Task = (InsertTask *)g_async_queue_try_pop (Self->Tasks)))  {
+		Task->Run();
+		delete Task;
 
-		// Skip the redundant start point boost required
-		for (polygon_traits<b_polygon>::iterator_type iPoint =
-				ThisPolygon.Outline.begin();
-				iPoint+1 != ThisPolygon.Outline.end();
-				++iPoint)  {
-			CreateNewPointInPolygon (NewPolygon,
-					gtl::x(*iPoint), gtl::y(*iPoint));
+		g_mutex_lock (&Self->Mutex);
+		--Self->Pending;
+		g_cond_signal (&Self->Done);
+		g_mutex_unlock (&Self->Mutex);
+
+		if (g_get_monotonic_time() >= Until)  {
+			Draw();
+			return TRUE;
 		}
+	}
+	Draw();
+
+	// A task pushed after the queue was found empty but before this
+	// test will see the handler as still installed, so look again.
+	g_mutex_lock (&Self->Mutex);
+	bool Empty = !g_async_queue_length (Self->Tasks);
+	if (Empty)  {
+		Self->Draining = false;
+		g_cond_signal (&Self->Done);
+	}
+	g_mutex_unlock (&Self->Mutex);
+	return Empty ? FALSE : TRUE;
+}
 
-		foreach(b_polygon Intersection, ThisPolygon.CutOuts) {
+void
+InsertQueue::Wait()
+{
+	g_mutex_lock (&Mutex);
+	while (Pending > 0 || Draining)  {
+		g_cond_wait (&Done, &Mutex);
+	}
+	g_mutex_unlock (&Mutex);
+}
 
-			CreateNewHoleInPolygon(NewPolygon);
+void
+Layer::BuildPolygon(const b_polygon &Outline, const RingSet &Rings,
+		const vector<size_t> &CutOuts, UnionInsert &Task)
+{
+	// Skip the redundant start point boost required.  The first point of
+	// each cutout is repeated by the intersection operator, so is not
+	// stored in the first place.
+	PolygonTypePtr NewPolygon = Task.Polygons.Add(
+			// FULLPOLYFLAG would make bisection of stippled areas occur.
+			MakeFlags(CLEARPOLYFLAG), FlatPointCount(Outline, Rings, CutOuts),
+			CutOuts.size());
+	FlattenStippled(Outline, Rings, CutOuts,
+			NewPolygon->Points, NewPolygon->HoleIndex);
+
+	SetPolygonBoundingBox (NewPolygon);
+	Task.Fingerprints.push_back(Fingerprint(NewPolygon));
+}
 
-			// The first point is repeated by the intersection
-			// operator, so is not added in.
-			for (polygon_traits<b_polygon>::iterator_type iPoint =
-					Intersection.begin();
-					iPoint != Intersection.end(); ++iPoint) {
+void
+Layer::BuildPolygons(const StippledPolygon &ThisPolygon, UnionInsert &Task)
+{
+	if (ThisPolygon.Unchanged)  {
+		return;
+	}
 
-				CreateNewPointInPolygon (NewPolygon,
-						gtl::x(*iPoint), gtl::y(*iPoint));
-			}
+	vector<StippledPiece> Pieces;
+	if (SplitHoles > 0 && ThisPolygon.CutOuts.Size() > (size_t)SplitHoles &&
+			Pattern.Cell == StipplePattern::Diamond && !Pattern.Turned())  {
+		Pieces = SplitStippledPolygon(
+				ThisPolygon, Spacing, SplitHoles, *Booleans);
+		if (Pieces.empty())  {
+			Log("Could not split a union of %d holes, inserting it whole\n",
+					(int)ThisPolygon.CutOuts.Size());
 		}
+	}
 
-		SetPolygonBoundingBox (NewPolygon);
-		if (!layer->polygon_tree)
-			layer->polygon_tree = r_create_tree (NULL, 0, 0);
-		r_insert_entry (layer->polygon_tree,
-				(BoxTypePtr) NewPolygon, 0);
-		AddObjectToCreateUndoList (
-				POLYGON_TYPE, layer, NewPolygon, NewPolygon);
+	if (!Pieces.empty())  {
+		foreach(const StippledPiece &Piece, Pieces)  {
+			BuildPolygon(Piece.Outline, ThisPolygon.CutOuts, Piece.CutOuts,
+					Task);
+		}
+	} else  {
+		vector<size_t> CutOuts(ThisPolygon.CutOuts.Size());
+		for (size_t r = 0; r < CutOuts.size(); r++)  {
+			CutOuts[r] = r;
+		}
+		BuildPolygon(ThisPolygon.Outline, ThisPolygon.CutOuts, CutOuts, Task);
 	}
 
 	// Again for overlays for lines, vias and pads.
-	foreach(StippledPolygon ThisPolygon, StippledPolygons) {
-
-		foreach(b_polygon Overlay, ThisPolygon.Overlays) {
+	foreach(const b_polygon &Overlay, ThisPolygon.Overlays) {
 
-			PolygonTypePtr NewPolygon =
-					CreateNewPolygon (layer, MakeFlags(FULLPOLYFLAG | CLEARPOLYFLAG));
+		PolygonTypePtr NewPolygon = Task.Polygons.Add(
+				MakeFlags(FULLPOLYFLAG | CLEARPOLYFLAG), Overlay.size(), 0);
+		FlattenOverlay(Overlay, NewPolygon->Points);
 
-			// The first point is repeated by the intersection
-			// operator, so is not added in.
-			for (polygon_traits<b_polygon>::iterator_type iPoint =
-					Overlay.begin();
-					iPoint != Overlay.end(); ++iPoint) {
+		SetPolygonBoundingBox (NewPolygon);
+		Task.Fingerprints.push_back(Fingerprint(NewPolygon));
+	}
+}
 
-				CreateNewPointInPolygon (NewPolygon,
-						gtl::x(*iPoint), gtl::y(*iPoint));
-			}
+void
+Layer::Insert(const StippledPolygon &ThisPolygon, LayerInsert &Target)
+{
+	PhaseClock Clock;
 
-			SetPolygonBoundingBox (NewPolygon);
-			if (!layer->polygon_tree)
-				layer->polygon_tree = r_create_tree (NULL, 0, 0);
-			r_insert_entry (layer->polygon_tree,
-				(BoxTypePtr) NewPolygon, 0);
-			AddObjectToCreateUndoList (
-					POLYGON_TYPE, layer, NewPolygon, NewPolygon);
-		}
+	if (Export)  {
+		TraceSpan Exporting("export union");
+		Export->Add(ThisPolygon);
+		Clock.Charge(Report.Times, InsertPhase);
+		return;
 	}
+
+	TraceSpan Building("build polygons");
+	UnionInsert *Task = new UnionInsert(Target, ThisPolygon);
+
+	BuildPolygons(ThisPolygon, *Task);
+	Clock.Charge(Report.Times, InsertPhase);
+	Building.End();
+
+	Inserts->Push(Task);
 }
 
 void
@@ -491,9 +1079,6 @@ Layer::MakeLayer(int i)
 
 	b_polygon_set Union;
 	vector<b_polygon> PolygonSet;
-	vector<StippledPolygon> StippledPolygons;
-
-	static GMutex mutex;
 
 	if (MakeDelete == MakeLayers)  {
 
@@ -503,34 +1088,50 @@ Layer::MakeLayer(int i)
 			MakeLayerNames[i] = solder_stipple;
 		}
 
+		// Nothing is kept or made, so the layer is cleared of stipples.
 		if	(NULL != (layer = FindLayerByName(MakeLayerNames[i])))  {
-			POLYGON_LP(layer);
-			{
-				ErasePolygon(polygon);
-				MoveObjectToRemoveUndoList (
-						POLYGON_TYPE, layer, polygon, polygon);
-			}
-			END_LOOP;
+			Inserts->Push(new LayerFinish(
+					new LayerInsert(layer, g_get_monotonic_time()), true, NULL));
 		}
 		return;
 	}
 
 	if	(NULL != (layer = FindLayerByName(MakeLayerNames[i])))  {
 
+		PhaseClock Clock;
+		gint64 Start = g_get_monotonic_time();
+
+		if (RunTrace)  {
+			RunTrace->NameThread(string("layer ") + layer->Name);
+		}
+
 		PolygonSet.clear();
 		Union.clear();
-		StippledPolygons.clear();
 
-		PolygonSet = ReadTemplatePolygons(layer);
-		if (Cancel)  {
+		TraceSpan Reading("read templates");
+		ReadTemplatePolygons(layer).swap(PolygonSet);
+		if (Cancel.IsRaised())  {
 			return;
 		}
+		Clock.Charge(Report.Times, ReadPhase);
+		Reading.End();
+		Report.Template = layer->Name;
+		Report.Templates = PolygonSet.size();
 
 		// Merge overlapping polygons so a perimeter may be drawn around
-		// each individual island despite overlaps.
-		foreach(b_polygon Polygon, PolygonSet) {
-			Union |= Polygon;
+		// each individual island despite overlaps.  Templates far apart
+		// are never merged together, and the rest are merged in a tree
+		// across the TilePool.
+		TraceSpan Merging("merge templates");
+		PooledUnionReduction Reduction;
+		Reduction.Plan(PolygonSet, *Booleans);
+		Reduction.Calculate();
+		if (Cancel.IsRaised())  {
+			return;
 		}
+		Reduction.Result().swap(Union);
+		Clock.Charge(Report.Times, UnionPhase);
+		Merging.End();
 
 		if (MakeLayerNames[i] == component_perimeter)  {
 
@@ -547,12 +1148,48 @@ Layer::MakeLayer(int i)
 
 		if	(NULL != (layer = FindLayerByName(MakeLayerNames[i])))  {
 
-			StippledPolygons =
-					CalculateStipples(layer, Union, Trace, Pitch, i);
+			// An exported layer is written union by union, and the board
+			// is left as it was.
+			GerberWriter Writer;
+			string File = GerberFile + "-" + layer->Name + ".gbr";
+			Export = NULL;
+			if (!GerberFile.empty())  {
+				if (!Writer.Open(File, layer->Name, PCB->MaxHeight))  {
+					Log("Could not write the stipple Gerber to %.80s\n",
+							File.c_str());
+					return;
+				}
+				Export = &Writer;
+			}
+
+			// The layer's last task files its report, once the board has
+			// been changed.
+			LayerInsert *Target = new LayerInsert(layer, Start);
+			CalculateStipples(layer, Union, Trace, Pitch, i,
+					StippledUnions(layer), *Target);
+			Target->Partial = Cancel.IsRaised();
+
+			bool Erase = MakeSelected != MakeLayers && !Export;
+			if (Export && Target->Partial)  {
+				// Half a layer is not something to send to a fab.
+				Writer.Close();
+				g_unlink(File.c_str());
+				Log("Stipple Gerber canceled, %.80s removed\n", File.c_str());
+				Export = NULL;
+			} else if (Export)  {
+				if (Writer.Close())  {
+					Log("Stipple Gerber: %.96s\n", File.c_str());
+				} else  {
+					Log("Could not write the stipple Gerber to %.80s\n",
+							File.c_str());
+				}
+				Export = NULL;
+			}
 
-			g_mutex_lock (&mutex);
-			InsertToPCB(layer, StippledPolygons);
-			g_mutex_unlock (&mutex);
+			Report.Stipple = layer->Name;
+			Report.Trace = Trace;
+			Report.Pitch = Pitch;
+			Inserts->Push(new LayerFinish(Target, Erase, &Report));
 		}
 	}
 }
@@ -82,6 +82,41 @@ is inserted to a second (presumably empty) layer of the pcb.   Then, holes
 are poked in the polygons, with bounding boxes around all vias, lines,
 and element pads.
 
+\subsection Batch Stippling without a Display
+Given arguments, the "sp" action skips the dialog and stipples at once,
+so boards may be done unattended by PCB's batch GUI:
+
+<pre>
+pcb --gui batch --action-string \
+    "sp(Both, 700, 4500, 700, 7000, Threads=8) SaveTo(LayoutAs, out.pcb) Quit()" \
+    board.pcb
+</pre>
+
+The first argument is one of Top, Bottom, Both, Selected or Delete.  It is
+followed by the component trace and pitch, then the solder trace and pitch,
+in the dialog's units; any left off are taken from the prefs file.  Threads
+limits the tile workers, which otherwise number one per processor.
+
+\subsection Report The Run Report
+Every run writes a JSON report, to ~/.pcb/stipple_report.json or to the
+file given as Report=file on the "sp" command line.  For each layer, and
+each union within it, the report gives the wall and CPU time of every
+phase (template read, union, keepout load, lattice generation, container
+intersection, overlay intersection, stitching and PCB insertion), along
+with the vertex, hole and keepout counts and the peak resident memory.
+
+Given Trace=file on the command line, or STIPPLE_TRACE=file in the
+environment of a dialog run, the run also records a timeline of its
+threads: the phases of each layer, the tiles and their phases on the
+workers, and the waits for tiles and for the insertion lock.  The file
+opens in chrome://tracing or Perfetto.
+
+\subsection Backend Boolean Geometry Backends
+The unions, clipping and shrinking are done by boost::polygon, unless
+Backend=geometry on the command line, or STIPPLE_BACKEND=geometry for a
+dialog run, asks for boost::geometry.  Unions stippled by another backend
+hash differently, so they are never mistaken for one another.
+
 \subsection Polygon Rendering within PCB
 
 \image html ButtonClip.png
@@ -160,10 +195,12 @@ extern "C" {
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <iterator>
 #include <algorithm>
-#include <deque>
+#include <set>
+#include <map>
 
 #include <boost/math/constants/constants.hpp>
 #include <boost/polygon/polygon.hpp>
@@ -176,9 +213,9 @@ extern "C" {
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/point_xy.hpp>
 #include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/index/rtree.hpp>
 
-/// Shorthand for a boost iterator.
-#define foreach BOOST_FOREACH
+#include "geometry.hpp"
 
 /// Shorthand for a PCB Box.
 #define BoxTypePtr 		BoxType *
@@ -192,27 +229,6 @@ extern "C" {
 /// Shorthand for a PCB Polygon.
 #define PolygonTypePtr 	PolygonType *
 
-namespace gtl = boost::polygon;
-
-using namespace std;
-using namespace gtl;
-using namespace boost::polygon::operators;
-
-/// A shorthand for a set of coordinates from a boost polygon.
-typedef gtl::polygon_with_holes_data<int> 						b_polygon;
-
-/// A shorthand for boost points (coordinates).
-typedef gtl::polygon_traits<b_polygon>::point_type 				b_point;
-
-/// A shorthand for the boost polygon holes.
-typedef gtl::polygon_with_holes_traits<b_polygon>::hole_type 	b_hole;
-
-/// A shorthand for a boost collection of polygons.
-typedef std::vector<b_polygon> 									b_polygon_set;
-
-/// Used for rounding edges and drawing approximate circles.
-const double PI = boost::math::constants::pi<double>();
-
 /// the PCB name of the component perimeter layer.
 const string component_perimeter = "comp-perim";
 
@@ -225,15 +241,69 @@ const string solder_perimeter = "solder-perim";
 /// the PCB name of the solder stipple layer.
 const string solder_stipple = "solder-stipple";
 
+/// The prefix of the stipple layer attributes which record, for each union,
+/// the hash of its inputs and the fingerprints of the polygons made from it.
+const string stipple_attribute = "stipple-";
+
+/// The directory, under the user's home, of the stipple result cache.
+const string stipple_cache = "/.pcb/stipple_cache";
+
+/// The cache is trimmed, least recently used first, to this many bytes.
+const long StippleCacheLimit = 64L * 1024 * 1024;
+
+/// The run report is written here, under the user's home, unless the "sp"
+/// command line names another file.
+const string stipple_report = "/.pcb/stipple_report.json";
+
 /// Unit translation: 1 nanometer = .00003... mills.
 const double NanometerToMil = 3.93700787E10-5;
 
 /// Unit translation: 1 mil (1/1000 of an inch) = 254 nanometers.
 const Coord MilToNanometer = 254;
 
+/// A request to stop the run, raised from the dialog's thread and polled
+/// by every worker, atomically on both sides.
+class CancelToken
+{
+	public:
+
+		CancelToken() : Raised(0)  {}
+
+		void Raise()  { g_atomic_int_set(&Raised, 1); }
+
+		void Reset()  { g_atomic_int_set(&Raised, 0); }
+
+		bool IsRaised() const  { return g_atomic_int_get(&Raised); }
+
+	private:
+
+		volatile gint Raised;
+};
+
 /// The dialog box is on its own thread, so a cancel request is signaled
-/// by setting this variable.
-extern bool Cancel;
+/// by raising this token.
+extern CancelToken Cancel;
+
+/// The pool of workers shared by every layer thread, for tiles and the
+/// merges of the template union, sized to the number of processors on the
+/// machine unless TileThreads says otherwise.
+extern GThreadPool *TilePool;
+
+/// The number of tile workers asked for on the "sp" command line, or zero
+/// for one per processor.
+extern int TileThreads;
+
+/// True when the run was started from the dialog, so that the main loop is
+/// free to put the results on the board.  In batch mode the run holds the
+/// main thread, and the layer threads insert for themselves.
+extern bool InsertOnMainLoop;
+
+/// The boolean backend asked for by "Backend=" on the "sp" command line or
+/// by STIPPLE_BACKEND, or empty for the default.
+extern string BackendName;
+
+/// The boolean backend of the current run.
+extern const BooleanBackend *Booleans;
 
 extern Coord
 	/// The size trace to be used in stipples on the component layer
@@ -245,6 +315,23 @@ extern Coord
 	/// The pitch size (spacing) to be used on the solder layer
 	SolderPitch;
 
+/// The largest error allowed between an arc and the chords which stand for
+/// it in a keepout, or zero for the fixed 96 steps to a circle.
+extern Coord ArcTolerance;
+
+/// The most cutouts one stippled polygon may hold before its union is split
+/// into several, or zero to leave every union whole.  Only the upright
+/// diamond's webs run straight across its lattice, so unions of the other
+/// patterns are always left whole.
+extern int SplitHoles;
+
+/// The pattern of the current run, from "Pattern=" and "Angle=" on the "sp"
+/// command line, or upright diamonds.
+extern StipplePattern Pattern;
+
+/// The tessellation of ArcTolerance, for the current run.
+extern const ArcTessellation *Arcs;
+
 /// These correspond to the work order filled in by the operator in the dialog.
 enum MakeLayers_t
 { MakeTopLayer, MakeBottomLayer, MakeBothLayers, MakeSelected, MakeDelete };
@@ -268,6 +355,10 @@ void MakeAllLayers();
 /// entry point, this serves as a thunk to the Layer worker class
 void LayerFactory(int i);
 
+/// Since Gnome thread pools can not use a C++ decorated function as an
+/// entry point, this serves as a thunk to the PoolTask worker class
+void TaskFactory(gpointer Task, gpointer Unused);
+
 /// A simple log print to stout
 void Log(const char *format, ...);
 
@@ -349,23 +440,526 @@ void Log(const char *format, ...);
 
 #endif /* STIPPLE_HPP_ */
 
-/// A single boost polygon with all of it's cutouts.
-class StippledPolygon
+/// One piece of work handed to the TilePool: a tile, or a merge of the
+/// template union.
+class PoolTask
+{
+	public:
+
+		virtual ~PoolTask()  {}
+
+		/// Do the work on a pool thread.
+		virtual void Run() = 0;
+};
+
+/// A batch of tasks handed to the TilePool by one layer thread, with the
+/// handshake that thread uses to wait for the pool to finish them.
+class PoolBatch
+{
+	public:
+
+		PoolBatch();
+		~PoolBatch();
+
+		/// Hand a task to the pool.
+		void Push(PoolTask *Task);
+
+		/// Called by each task as it finishes.
+		void Finished();
+
+		/// Wait until every task pushed has finished.
+		void Wait();
+
+	private:
+
+		/// Tasks not yet finished, guarded by Mutex and signaled by Done.
+		int Pending;
+		GMutex Mutex;
+		GCond Done;
+};
+
+class PooledTileSet;
+
+/// A tile of a PooledTileSet, as a task.
+class TileTask : public PoolTask
+{
+	public:
+
+		void Run();
+
+		PooledTileSet *Set;
+		StippleTile *Tile;
+};
+
+/// A union's tiles as handed to the TilePool.
+class PooledTileSet : public StippleTileSet
+{
+	public:
+
+		/// Calculate every tile on the TilePool, and wait for them.
+		void Calculate();
+
+		/// Calculate one tile, unless the run has been canceled, and
+		/// report it finished.
+		void Run(StippleTile &Tile);
+
+		/// The index of the layer, for StippleProgress.
+		int Layer;
+
+	private:
+
+		vector<TileTask> Tasks;
+		PoolBatch Batch;
+};
+
+class PooledUnionReduction;
+
+/// A merge of a PooledUnionReduction, as a task.
+class MergeTask : public PoolTask
+{
+	public:
+
+		void Run();
+
+		PooledUnionReduction *Reduction;
+		size_t Merge;
+};
+
+/// The template union, with the merges of each level handed to the
+/// TilePool, so even a layer of thousands of templates uses every core.
+class PooledUnionReduction : public UnionReduction
+{
+	public:
+
+		/// Reduce every level on the TilePool, waiting for each in turn.
+		/// This gives up between levels if the run is canceled.
+		void Calculate();
+
+		/// Do one merge, unless the run has been canceled, and report it
+		/// finished.
+		void Run(size_t Merge);
+
+	private:
+
+		vector<MergeTask> Tasks;
+		PoolBatch Batch;
+};
+
+/// A via or an element pin, which keeps the stipple away on both sides of
+/// the board.
+class ThroughHole
+{
+	public:
+
+		/// The center of the hole.
+		Coord X, Y;
+
+		/// The diameter of the copper and its clearance, before the trace
+		/// width of a layer is added.
+		Coord Thickness, Clearance;
+
+		/// The ID of the owning element, or of the via itself.
+		long int ElementID;
+};
+
+/// The vias and pins within reach of every template layer, extracted once
+/// by the spool thread and then only read by the layer threads.  Each layer
+/// tessellates them with its own trace added.
+class ThroughHoleSet
+{
+	public:
+
+		/// Vias and pins, each in creation order.
+		vector<ThroughHole> Vias, Pins;
+
+		/// Search PCB's via and pin trees under the template polygons of
+		/// every layer in the work order.
+		void Load(Coord Trace);
+
+		/// Add the keepout for a hole on a layer with the given trace to
+		/// a batch.
+		void Add(OverlayBatch &Batch, const ThroughHole &Hole, Coord Trace) const;
+};
+
+/// The through-hole keepouts for the current run.
+extern ThroughHoleSet *ThroughHoles;
+
+/// Stippled unions kept on disk between sessions, one memory mapped file per
+/// union, named by the hash of everything the union depends upon.
+class StippleCache
+{
+	public:
+
+		StippleCache();
+		~StippleCache();
+
+		/// Fill in the geometry of the union cached under Key, returning
+		/// false if it has not been cached.
+		bool Fetch(const string &Key, StippledPolygon &Stippled);
+
+		/// Save the geometry of a freshly stippled union under Key.
+		void Store(const string &Key, const StippledPolygon &Stippled);
+
+		/// Remove the least recently used files until the cache fits.
+		void Trim();
+
+		/// Where the files are kept.
+		string Directory;
+
+		/// Counted for the log, and shared by the layer threads.
+		int Hits, Misses;
+		GMutex Mutex;
+};
+
+/// The result cache for the current run.
+extern StippleCache *ResultCache;
+
+/// What one union cost, for the run report.
+class UnionReport
+{
+	public:
+
+		UnionReport();
+
+		/// Fill in where the union came from, its output and its times.
+		/// Start is the monotonic time at which the union was begun.
+		void Finish(const char *Source, const StippledPolygon &Stippled,
+				gint64 Start);
+
+		/// The hash of the union's inputs.
+		string Hash;
+
+		/// "unchanged", "cached" or "stippled".
+		string Source;
+
+		/// The points and holes of the union itself.
+		long OutlineVertices, OutlineHoles;
+
+		/// The keepouts within reach of the union, and the tiles its
+		/// lattice was cut into.
+		long Keepouts, Tiles;
+
+		/// The cutouts and overlays made, and every point of the outline,
+		/// cutouts and overlays together.
+		long CutOuts, Overlays, Vertices;
+
+		/// Wall seconds from hashing the union to its finished geometry.
+		double Wall;
+
+		/// The lattice, container, overlay and stitch times.
+		PhaseTimes Times;
+};
+
+/// What one layer cost, for the run report.
+class LayerReport
+{
+	public:
+
+		LayerReport();
+
+		/// Add a finished union, and its times to the layer's.
+		void Add(const UnionReport &Union);
+
+		/// The names of the template and stipple layers.
+		string Template, Stipple;
+
+		Coord Trace, Pitch;
+
+		/// Template polygons read, keepouts loaded for the layer, and the
+		/// disjoint regions they were merged into.
+		long Templates, Keepouts, MergedKeepouts;
+
+		/// Wall seconds for the whole layer thread.
+		double Wall;
+
+		/// The layer thread's own read, union, load and insert times, and
+		/// the times of every union.
+		PhaseTimes Times;
+
+		/// The process's peak resident memory as the layer finished, in
+		/// kilobytes.
+		long PeakMemory;
+
+		vector<UnionReport> Unions;
+};
+
+/// The timings and geometry statistics of a run, written as JSON at its end.
+class StippleReport
+{
+	public:
+
+		StippleReport();
+		~StippleReport();
+
+		/// Add a finished layer.  Called by the layer threads.
+		void Add(const LayerReport &Layer);
+
+		/// Write the report to File, returning false if it could not be.
+		bool Write(const string &File);
+
+		/// The monotonic time and process CPU seconds as the run began.
+		gint64 Start;
+		double StartCpu;
+
+		/// The number of tile workers.
+		int Threads;
+
+		/// The name of the boolean backend.
+		string Backend;
+
+		/// The chord tolerance of arcs, in nanometers.
+		Coord Tolerance;
+
+		/// The most cutouts in one stippled polygon, or zero if unions
+		/// were not split.
+		int SplitHoles;
+
+		/// The shape and angle of the cutouts.
+		StipplePattern Pattern;
+
+		/// Set if the operator canceled the run.
+		bool Canceled;
+
+		/// The result cache's counts for the run.
+		int Hits, Misses;
+
+		/// The layers, in the order they finished, guarded by Mutex.
+		vector<LayerReport> Layers;
+		GMutex Mutex;
+};
+
+/// The report for the current run.
+extern StippleReport *RunReport;
+
+/// The file named by "Report=" on the "sp" command line, or empty for
+/// stipple_report under the user's home.
+extern string ReportFile;
+
+/// The CPU seconds the process has used, and its peak resident memory in
+/// kilobytes.  Both are zero where the system cannot say.
+void ProcessUsage(double &Cpu, long &PeakMemory);
+
+/// Text as a JSON string, quotes and all.
+string JsonQuote(const string &Text);
+
+/// A span of time on one thread of the trace.
+class TraceEvent
+{
+	public:
+
+		/// A string constant naming what was done.
+		const char *Name;
+
+		/// The monotonic times at which the span began and ended.
+		gint64 Start, End;
+};
+
+/// The events of one thread.  Only that thread adds to it, so no lock is
+/// taken.
+class TraceBuffer
+{
+	public:
+
+		/// The thread's number and name on the timeline.
+		int Thread;
+		string Name;
+
+		vector<TraceEvent> Events;
+};
+
+/// A timeline of what each thread did during a run, written in the Chrome
+/// trace event format for chrome://tracing or Perfetto.  Tracing is opt-in,
+/// by "Trace=" on the "sp" command line or STIPPLE_TRACE in the environment.
+class StippleTrace
 {
 	public:
 
-		/// Store the perimeter of a stippled region
-		b_polygon Outline;
+		StippleTrace();
+		~StippleTrace();
+
+		/// Record a span on the calling thread.
+		void Add(const char *Name, gint64 Start, gint64 End);
+
+		/// Name the calling thread on the timeline.
+		void NameThread(const string &Name);
+
+		/// Write the trace to File, returning false if it could not be.
+		bool Write(const string &File);
+
+		/// The monotonic time at which the trace began.
+		gint64 Start;
 
-		/// Cutouts are the holes in the regions
-		b_polygon_set CutOuts;
+	private:
 
-		/// Overlays are solid shadows for lines, vias and pads
-		/// which from (with clearance) featured borders within
-		/// stippled areas.
-		b_polygon_set Overlays;
+		/// The calling thread's buffer, made the first time it is asked for.
+		TraceBuffer *Buffer();
+
+		/// Tells this trace's buffers from those of earlier runs on a
+		/// thread which has outlived them.
+		int Run;
+
+		/// Every thread's buffer, guarded by Mutex.
+		vector<TraceBuffer *> Buffers;
+		GMutex Mutex;
 };
 
+/// The trace of the current run, or NULL when none is being taken.
+extern StippleTrace *RunTrace;
+
+/// The file named by "Trace=" on the "sp" command line or by STIPPLE_TRACE,
+/// or empty if the run is not to be traced.
+extern string TraceFile;
+
+/// Streams one stipple layer to an RS-274X Gerber file with X2 attributes,
+/// straight from the stippled unions and never through PCB's polygons.
+/// Each union is a dark G36/G37 region for its outline, a clear region for
+/// each cutout, dark regions for its overlays, and clear regions for the
+/// clearance of every line, via, pin and pad it overlaps, as PCB would
+/// clear them from the polygon.  It is written as soon as it is added
+/// through a buffer of its own, so the layer is never held whole.
+/// Units are millimeters to six places, which is to say nanometers.
+class GerberWriter
+{
+	public:
+
+		GerberWriter();
+		~GerberWriter();
+
+		/// Start File for the named layer, on a board Height high, as the
+		/// Gerber y axis runs up where PCB's runs down.
+		bool Open(const string &File, const string &Layer, b_coord Height);
+
+		/// Set the clearances of the layer's objects, to be cleared from
+		/// each union they overlap.
+		void Clear(const b_polygon_set &Clearances);
+
+		/// Write a stippled union's regions.
+		void Add(const StippledPolygon &Stippled);
+
+		/// End the file, returning false if any of it could not be written.
+		bool Close();
+
+	private:
+
+		/// Write a closed ring as one region.
+		template <class Iterator>
+		void Region(Iterator First, Iterator Last);
+
+		/// Write a draw to the point, or a move if not Draw, leaving out an
+		/// unchanged x or y, as Gerber coordinates are modal.
+		void Point(b_coord X, b_coord Y, bool Draw);
+
+		/// Switch between dark and clear polarity.
+		void Polarity(bool Dark);
+
+		void Put(const char *Text);
+		void Flush();
+
+		FILE *Out;
+		bool Failed;
+
+		/// The objects' clearances, and the extents of each.
+		b_polygon_set Clearances;
+		vector< gtl::rectangle_data<b_coord> > ClearanceExtents;
+
+		/// Where the buffer is flushed from, and its size.
+		vector<char> Buffer;
+		size_t Used;
+
+		b_coord Height, LastX, LastY;
+		bool Moved, Dark;
+};
+
+/// The files named by "Gerber=" on the "sp" command line, to which each
+/// stipple layer is exported instead of being put on the board, or empty.
+extern string GerberFile;
+
+/// Records its own lifetime, or up to End, on the calling thread's
+/// timeline.  With no trace being taken, it costs a pointer test.
+class TraceSpan
+{
+	public:
+
+		TraceSpan(const char *Name)
+			: Name(Name), Start(RunTrace ? g_get_monotonic_time() : 0)  {}
+
+		~TraceSpan()  { End(); }
+
+		/// End the span before it goes out of scope.
+		void End()
+		{
+			if (RunTrace && Start)  {
+				RunTrace->Add(Name, Start, g_get_monotonic_time());
+			}
+			Start = 0;
+		}
+
+	private:
+
+		const char *Name;
+		gint64 Start;
+};
+
+/// The progress of a run, counted by the layer threads and tile workers
+/// and read by the dialog's timer.  Every count is atomic, so neither side
+/// takes a lock, and nothing is allocated or formatted while stippling; the
+/// timer makes the message from the counts.
+class ProgressChannel
+{
+	public:
+
+		ProgressChannel();
+
+		/// Start a run over the named layers.  This must be called before
+		/// the timer or any worker can look at the counts.
+		void Begin(const vector<string> &LayerNames);
+
+		/// A layer has found how many unions it is to stipple.
+		void Unions(int Layer, int Count);
+
+		/// A layer has started a union of so many tiles, which becomes
+		/// the one the message tells of.
+		void StartUnion(int Layer, int Tiles);
+
+		/// A worker has finished one tile of the layer's current union.
+		void TileDone(int Layer);
+
+		/// A layer has finished its current union.
+		void UnionDone(int Layer);
+
+		/// The run is over.
+		void Finish();
+
+		/// The fraction of the run done, from 0 to 1.
+		double Fraction() const;
+
+		/// The union being worked on, or how the run stands.
+		string Message() const;
+
+		/// True once Finish has been called.
+		bool Finished() const;
+
+	private:
+
+		/// The counts of one layer.
+		struct LayerCounts
+		{
+			volatile gint Unions, UnionsDone, Tiles, TilesDone;
+		};
+
+		/// Fixed by Begin, and then only read.
+		vector<string> Names;
+		vector<LayerCounts> Layers;
+
+		/// The layer which last started a union, or -1 before any has.
+		volatile gint Current;
+
+		volatile gint Done;
+};
+
+/// The progress of the current run.
+extern ProgressChannel StippleProgress;
+
 /// The main user interface.
 class StippleDialog  {
 
@@ -377,62 +971,329 @@ private:
 	/// Populate the dialog with sane values.
 	bool ReadDefaults();
 
+	/// Fill in the layer names for the work order in MakeLayers.
+	static void WorkOrder();
+
 public:
 
 	/// OK/Cancel listeners
 	static void ButtonPress( GtkButton *widget, gpointer data );
 
+	/// Undo/Redo listeners, for the runs PCB's own undo does not cover.
+	static void UndoPress( GtkButton *widget, gpointer data );
+
 	/// Each time a key is typed the percent fill is updated
 	static void KeyPress( GtkButton *widget, gpointer data );
 
-	/// Receive a percent complete message.
+	/// Show StippleProgress on the progress bar and its label.
 	static gboolean UpdateProgress(GtkProgressBar *PB);
 
-	/// Interface for setting progress bar
-	static void Progress(float progress, string Message);
-
 	/// Return the percent fill represented by the input parameters
 	static int PercentFill(double Trace, double Pitch);
 
 	/// The single dialog this add-in uses for creating a work order.
 	void ParameterDialog();
 
+	/// Take the work order from the "sp" arguments instead of the dialog,
+	/// and stipple on the calling thread.  This is how boards are done
+	/// without a display, from PCB's batch GUI.
+	int Batch(int argc, char **argv);
+
+};
+
+/// New PCB polygons, built away from any layer so that only their linking
+/// is done under the insert lock.  Each polygon's points and holes are
+/// allocated once, at the size the stipple already knows, where PCB would
+/// grow them a point at a time.
+class PolygonBatch
+{
+	public:
+
+		PolygonBatch() : Polygons(NULL), Count(0), Points(0) {}
+
+		/// Free whatever was never linked onto a layer.
+		~PolygonBatch();
+
+		/// A polygon with room for the given number of points and holes,
+		/// all of which the caller fills in.
+		PolygonTypePtr Add(FlagType Flags, Cardinal PointN, Cardinal HoleN);
+
+		/// Number the polygons and their points as PCB would have, append
+		/// them to the layer and index them, noting each in Linked, and
+		/// mark them to be drawn.  PCB owns them from here on, and
+		/// StippleJournal undoes them.  A layer with no polygons yet has its
+		/// tree loaded in one call.
+		void Link(LayerTypePtr layer, std::set<PolygonTypePtr> &Linked);
+
+	private:
+
+		/// The polygons, last first.
+		GList *Polygons;
+
+		Cardinal Count, Points;
 };
 
+/// The fingerprint of a PCB polygon's points and holes.
+string Fingerprint(PolygonTypePtr Polygon);
+
+/// A change to the board, made on whichever thread holds PCB's data: the
+/// main loop's when the dialog started the run, or the layer thread's, one
+/// at a time, in batch mode.
+class InsertTask
+{
+	public:
+
+		virtual ~InsertTask() {}
+
+		virtual void Run() = 0;
+};
+
+/// What the run has done to one stipple layer so far.  It is made by the
+/// layer's thread, and then only touched by the layer's tasks, in order.
+class LayerInsert
+{
+	public:
+
+		LayerInsert(LayerTypePtr layer, gint64 Start);
+
+		LayerTypePtr Stipple;
+
+		/// The fingerprints of polygons from unchanged unions, and the
+		/// hashes of every union of this run.
+		std::set<string> Keep, Current;
+
+		/// The polygons this run has put on the layer.
+		std::set<PolygonTypePtr> Made;
+
+		int Reused, Unions;
+
+		/// The template unions the run got to, and whether it was canceled
+		/// before it got to them all.
+		b_polygon_set Reached;
+		bool Partial;
+
+		/// Whether a polygon on the layer overlaps a union the run got to,
+		/// and so is replaced by it.
+		bool Reaches(PolygonTypePtr Polygon) const;
+
+		/// The layer's stipple attributes before the run, for the journal.
+		vector< pair<string, string> > Attributes;
+
+		/// The time spent changing the board for the layer.
+		PhaseTimes Times;
+
+		/// When the layer's thread began.
+		gint64 Start;
+};
+
+/// One union's polygons, built by the layer's thread, to be put on the
+/// layer.  An unchanged union has none, and only keeps what it made before.
+class UnionInsert : public InsertTask
+{
+	public:
+
+		UnionInsert(LayerInsert &Target, const StippledPolygon &Union);
+
+		LayerInsert &Target;
+
+		string Hash;
+		bool Unchanged;
+
+		PolygonBatch Polygons;
+
+		/// The fingerprints of Polygons, in order.
+		vector<string> Fingerprints;
+
+		void Run();
+};
+
+/// The end of a layer.  The stipples the run did not keep or make are
+/// erased, unless only the selected polygons were stippled, and the layer
+/// is reported.  The layer's LayerInsert goes with it.
+class LayerFinish : public InsertTask
+{
+	public:
+
+		/// With no Report, as when stipples are only being deleted, the
+		/// layer is neither logged nor reported.
+		LayerFinish(LayerInsert *Target, bool Erase, const LayerReport *Report);
+
+		~LayerFinish();
+
+		LayerInsert *Target;
+		bool Erase;
+		LayerReport *Report;
+
+		void Run();
+};
+
+/// The tasks of every layer thread, run in the order they are pushed.  With
+/// a main loop, they go onto a GAsyncQueue which an idle handler drains, a
+/// few milliseconds at a time, drawing what each slice linked, so results
+/// show up as each union finishes and the GUI stays responsive; the layer
+/// threads never wait on it.  Without one, each task is run as it is
+/// pushed, under a lock.
+class InsertQueue
+{
+	public:
+
+		InsertQueue(bool MainLoop);
+		~InsertQueue();
+
+		/// Hand over a task, which the queue then owns.
+		void Push(InsertTask *Task);
+
+		/// Wait until every task pushed has been run.  This must not be
+		/// called from the main loop.
+		void Wait();
+
+	private:
+
+		/// The idle handler, which drains the queue until its time is up.
+		static gboolean Drain(gpointer Queue);
+
+		GAsyncQueue *Tasks;
+		bool MainLoop;
+
+		/// Tasks not yet run, and whether the idle handler is installed,
+		/// guarded by Mutex and signaled by Done.
+		int Pending;
+		bool Draining;
+		GMutex Mutex;
+		GCond Done;
+};
+
+/// The insert queue of the current run.
+extern InsertQueue *Inserts;
+
+/// The stipple attributes of a layer, each by its whole name.
+vector< pair<string, string> > StippleAttributes(LayerTypePtr layer);
+
+/// One layer's share of a stipple run, packed small.  Whichever side of the
+/// run is off the board, the polygons it removed or those it added, is kept
+/// as packed geometry, and the side on the board as the IDs of its
+/// polygons, so that undoing and redoing are the same step.
+class LayerDelta
+{
+	public:
+
+		/// The stipple layer's name.
+		string Layer;
+
+		/// The polygons off the board, each as its flags, counts, hole
+		/// offsets and points, every number a variable length delta.
+		string Off;
+
+		/// The IDs of the polygons on the board, in order, packed the same
+		/// way.
+		string On;
+
+		/// The layer's stipple attributes as they were with Off on the
+		/// board.
+		vector< pair<string, string> > Attributes;
+
+		/// Pack a polygon onto Off.
+		void Pack(PolygonTypePtr Polygon);
+
+		/// Set On to the IDs of the given polygons.
+		void Record(const std::set<PolygonTypePtr> &Polygons);
+
+		/// Whether the layer is on the board, with every polygon of On.
+		/// PCB never reuses an ID, so a layer edited since has lost some.
+		bool Present() const;
+
+		/// Take the polygons of On off the board, and put those of Off
+		/// back on, with their attributes.
+		void Swap();
+
+		/// The bytes held.
+		size_t Size() const;
+};
+
+/// The stipple runs which may be undone with sp(Undo), or the dialog's Undo,
+/// and redone with sp(Redo) or Redo.  PCB's own undo list would take an entry, and keep a whole
+/// polygon, for every polygon a run adds or removes; here a run is one step
+/// of packed deltas, and only the last JournalRuns runs, of no more than
+/// JournalBytes in all, are kept.  Layers are recorded by their last tasks,
+/// and undone from the main thread.  The runs are of one board, and are
+/// forgotten when another is loaded or a layer is edited under them.
+class StippleJournal
+{
+	public:
+
+		StippleJournal();
+		~StippleJournal();
+
+		/// Start recording a run on the current board, which forgets
+		/// whatever was undone, and every run of another board.
+		void Begin();
+
+		/// Record a layer's changes into the run, taking Delta's contents.
+		void Add(LayerDelta &Delta);
+
+		/// File the run, unless it changed nothing.
+		void Commit();
+
+		/// Undo the last run, or redo the last run undone.  False if there
+		/// is none.
+		bool Undo();
+		bool Redo();
+
+	private:
+
+		typedef vector<LayerDelta> Run;
+
+		/// Move the last run of From onto To, swapping each layer.
+		bool Step(vector<Run> &From, vector<Run> &To);
+
+		/// The bytes a run holds.
+		static size_t Size(const Run &Deltas);
+
+		/// Whether PCB is still the board the runs were made on.
+		bool SameBoard() const;
+
+		/// Forget every run, with Mutex held.
+		void Clear();
+
+		Run Current;
+
+		/// The board the runs were made on, by its address and file name.
+		PCBType *Board;
+		string BoardFile;
+
+		/// Runs which may be undone, oldest first, and runs which may be
+		/// redone, guarded by Mutex.
+		vector<Run> Done, Undone;
+		GMutex Mutex;
+};
+
+/// The stipple runs of this session.
+extern StippleJournal Journal;
+
 /// Worker thread for a single layer's stipple processing.
 class Layer
 {
 
 protected:
 
-	/// Return the angle between two points on a plane.
-	double Angle2D(
-			int X0, int Y0,
-			int X1, int Y1);
-
 	/// Loop through the layer names from the host program and find the one
 	/// which matches the supplied name, or return NULL.
 	LayerTypePtr FindLayerByName(string Name);
 
-	/// Using a finite number of line segments, approximate a circle.
-	b_polygon MakeCircularOverlay(
-			Coord x, Coord y, Coord Radius, int SegmentCount = 24);
-
-	/// Remove a square inset from a polygon.
-	b_polygon MakeRectangularOverlay(
-			Coord x0, Coord y0, Coord x1, Coord y1, Coord Thickness);
-
-	/// Make a rounded rectangle, using line segments to approximate the
-	/// rounded corners.
-	b_polygon MakeRoundedRectangle(
-			int x0, int y0, int x1, int y1, int Radius, int Smoothness);
-
 	/// Read and store all polygons on the template layer.
 	b_polygon_set ReadTemplatePolygons(LayerTypePtr layer);
 
+	/// The hashes of the unions already on a stipple layer, each with the
+	/// fingerprints of the polygons which were made from it.
+	map<string, string> StippledUnions(LayerTypePtr layer);
+
 	/// Read all the keep-out information for the layer, which are all pins,
-	/// pads, vias and lines.
-	b_polygon_set LoadPCB(string LayerName, Coord Trace);
+	/// pads, vias and lines, from within reach of the unions.  Given
+	/// Clearances, each object's own clearance, without the trace, is added
+	/// to it as well.
+	b_polygon_set LoadPCB(
+			string LayerName, Coord Trace, const b_polygon_set &Union,
+			b_polygon_set *Clearances = NULL);
 
 	/// Form a minimum set of unions which cover all of the polygons from the
 	/// template layer, and where each union is the largest island which can
@@ -442,20 +1303,43 @@ protected:
 	/// each inset with the assembled union to allow for any shape of bounding
 	/// region.  It is the intersection of each diamond inlay with its enclosing
 	/// polygon union which accounts for the glacial run-time of this add-in.
-	vector<StippledPolygon> CalculateStipples(
-			LayerTypePtr layer, b_polygon_set Union,
-			Coord Trace, Coord Pitch, int i);
-
-	/// Once all of the new polygons have been calculated using Boost
-	/// polygons, convert them to a PCB data structure.
-	void InsertToPCB(
-			LayerTypePtr layer, vector<StippledPolygon> StippledPolygons);
+	/// Unions whose hash is found in Existing are passed over.  Each union
+	/// is handed to Inserts as soon as it is done.
+	void CalculateStipples(
+			LayerTypePtr layer, const b_polygon_set &Union,
+			Coord Trace, Coord Pitch, int i,
+			const map<string, string> &Existing, LayerInsert &Target);
+
+	/// The times and statistics of this layer, for the run report.
+	LayerReport Report;
+
+	/// The distance between diamonds of the layer's lattice, along whose
+	/// webs unions are split.
+	b_coord Spacing;
+
+	/// Add one stippled PCB polygon to Task, the outer ring of Outline with
+	/// the given rings of Rings as its holes.
+	void BuildPolygon(const b_polygon &Outline, const RingSet &Rings,
+			const vector<size_t> &CutOuts, UnionInsert &Task);
+
+	/// Once a union has been calculated using Boost polygons, convert it
+	/// to PCB polygons, and record their fingerprints.  A union with more
+	/// than SplitHoles cutouts is split into several polygons.  Nothing
+	/// here touches the board.
+	void BuildPolygons(const StippledPolygon &ThisPolygon, UnionInsert &Task);
+
+	/// Build a union's PCB polygons, and hand them to Inserts, or write
+	/// the union to Export instead if there is one.
+	void Insert(const StippledPolygon &ThisPolygon, LayerInsert &Target);
+
+	/// The Gerber file the layer is being exported to, or NULL.
+	GerberWriter *Export;
 
 public:
 
-	/// Insert the new stippled polygons into the PCB program using
-	/// the published interface. A Gnome Mutex is used since each layer
-	/// runs in its own thread, and insertion could result in collisions.
+	/// Stipple one layer, and have the new stippled polygons inserted into
+	/// the PCB program, using the published interface, by Inserts.  Each
+	/// layer runs in its own thread, so only the queue changes the board.
 	void MakeLayer(int i);
 };
 
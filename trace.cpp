@@ -0,0 +1,140 @@
+/*
+ *                            COPYRIGHT
+ *
+ *  Stipple, cross hatching add-in for gEDA PCB
+ *  Copyright (C) 2015 Charles Repetti
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+*/
+
+
+/**
+ * \file trace.cpp
+ * \brief The opt-in timeline of the run's threads.
+ *
+ * Each thread appends to a buffer of its own, found through a GPrivate, so
+ * recording a span takes no lock.  The buffers are gathered and written as
+ * Chrome trace events once every thread has been joined.
+ */
+
+#include "stipple.hpp"
+
+StippleTrace *RunTrace;
+string TraceFile;
+
+/// The calling thread's buffer in the trace of a given run.
+struct TraceSlot
+{
+	int Run;
+	TraceBuffer *Buffer;
+};
+
+static void
+FreeSlot(gpointer Slot)
+{
+	delete (TraceSlot *)Slot;
+}
+
+static GPrivate ThreadSlot = G_PRIVATE_INIT(FreeSlot);
+
+/// Counts the traces taken, so each may tell its buffers from old ones.
+static int Runs;
+
+StippleTrace::StippleTrace()
+	: Start(g_get_monotonic_time()), Run(++Runs)
+{
+	g_mutex_init (&Mutex);
+}
+
+StippleTrace::~StippleTrace()
+{
+	foreach(TraceBuffer *Buffer, Buffers)  {
+		delete Buffer;
+	}
+	g_mutex_clear (&Mutex);
+}
+
+TraceBuffer *
+StippleTrace::Buffer()
+{
+	TraceSlot *Slot = (TraceSlot *)g_private_get(&ThreadSlot);
+
+	if (!Slot)  {
+		Slot = new TraceSlot();
+		g_private_set(&ThreadSlot, Slot);
+	}
+
+	if (Slot->Run != Run)  {
+		TraceBuffer *Buffer = new TraceBuffer();
+
+		g_mutex_lock (&Mutex);
+		Buffer->Thread = Buffers.size() + 1;
+		Buffer->Name = str(boost::format("thread %d") % Buffer->Thread);
+		Buffers.push_back(Buffer);
+		g_mutex_unlock (&Mutex);
+
+		Slot->Run = Run;
+		Slot->Buffer = Buffer;
+	}
+	return Slot->Buffer;
+}
+
+void
+StippleTrace::Add(const char *Name, gint64 Start, gint64 End)
+{
+	TraceEvent Event;
+
+	Event.Name = Name;
+	Event.Start = Start;
+	Event.End = End;
+	Buffer()->Events.push_back(Event);
+}
+
+void
+StippleTrace::NameThread(const string &Name)
+{
+	Buffer()->Name = Name;
+}
+
+bool
+StippleTrace::Write(const string &File)
+{
+	std::ostringstream Out;
+	bool First = true;
+
+	Out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	foreach(const TraceBuffer *Buffer, Buffers)  {
+
+		Out << (First ? "" : ",\n")
+			<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+			<< "\"tid\": " << Buffer->Thread << ", \"args\": {\"name\": "
+			<< JsonQuote(Buffer->Name) << "}}";
+		First = false;
+
+		foreach(const TraceEvent &Event, Buffer->Events)  {
+			Out << ",\n{\"name\": " << JsonQuote(Event.Name)
+				<< ", \"cat\": \"stipple\", \"ph\": \"X\", \"pid\": 1, "
+				<< "\"tid\": " << Buffer->Thread
+				<< ", \"ts\": " << Event.Start - Start
+				<< ", \"dur\": " << Event.End - Event.Start << "}";
+		}
+	}
+	Out << "\n]}\n";
+
+	string Contents = Out.str();
+	return g_file_set_contents(File.c_str(),
+			Contents.c_str(), Contents.size(), NULL);
+}